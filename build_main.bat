@@ -1,2 +1,2 @@
 @echo off
-g++ main.cpp input.cpp maze.cpp testCommand/shellGame.cpp testCommand/fileSystem.cpp testCommand/commandProcessor.cpp testCommand/Process.cpp -o maze_on_terminal.exe
\ No newline at end of file
+g++ main.cpp input.cpp maze.cpp testCommand/shellGame.cpp testCommand/fileSystem.cpp testCommand/commandProcessor.cpp testCommand/process.cpp -o maze_on_terminal.exe
\ No newline at end of file
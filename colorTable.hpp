@@ -0,0 +1,88 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+//色番号とRGBの対応．色番号は0~15が16色(hue | 強調<<3，Win32の属性値と同じ並び)
+//16~255がxtermの256色(6x6x6の色立方体と24段階の灰色)
+namespace col
+{
+    //端末が出せる色の数
+    enum class ColorMode {
+        Basic16,  // 16色 (Win32コンソールと色指定に対応していない端末)
+        Xterm256, // 256色 (ESC[38;5;n m)
+        TrueColor // 24bit．セルは256色の番号しか持たないので，送り方はXterm256と同じ
+    };
+
+    struct RGB {
+        unsigned char r, g, b;
+    };
+
+    //色番号のRGB．0~15は端末の設定で変わるのでxtermの既定値で代表させる
+    inline RGB rgbOf(unsigned char code){
+        if(code < 16){
+            bool intense = (code & 8) != 0;
+            int hue = code & 7;
+            if(hue == 0) return intense ? RGB{127, 127, 127} : RGB{0, 0, 0};
+            if(hue == 7 && !intense) return RGB{229, 229, 229};
+            unsigned char v = intense ? 255 : 205;
+            return RGB{(unsigned char)((hue & 4) ? v : 0), (unsigned char)((hue & 2) ? v : 0), (unsigned char)((hue & 1) ? v : 0)};
+        }
+        if(code < 232){
+            int i = code - 16;
+            static const unsigned char levels[6] = {0, 95, 135, 175, 215, 255};
+            return RGB{levels[i / 36], levels[(i / 6) % 6], levels[i % 6]};
+        }
+        unsigned char gray = (unsigned char)(8 + 10 * (code - 232));
+        return RGB{gray, gray, gray};
+    }
+
+    inline int colorDistance(RGB a, RGB b){
+        int dr = a.r - b.r, dg = a.g - b.g, db = a.b - b.b;
+        return dr*dr + dg*dg + db*db;
+    }
+
+    //codesの中でrgbに一番近い色番号
+    inline unsigned char nearestCode(RGB rgb, int firstCode, int lastCode){
+        int best = firstCode, bestDistance = 1 << 30;
+        for(int code=firstCode; code<=lastCode; code++){
+            int d = colorDistance(rgb, rgbOf((unsigned char)code));
+            if(d < bestDistance){
+                bestDistance = d;
+                best = code;
+            }
+        }
+        return (unsigned char)best;
+    }
+
+    //RGB(0~1)を256色の番号にする．各成分5bitの立方体の表を最初の呼び出しで一度だけ作るので
+    //色を引くたびに探すことはない．16色は端末ごとに色が違うので16~255から選ぶ
+    inline unsigned char quantize(double r, double g, double b){
+        static const int BITS = 5;
+        static const int SIZE = 1 << BITS;
+        static const std::vector<unsigned char> table = [](){
+            std::vector<unsigned char> t(SIZE * SIZE * SIZE);
+            for(int ri=0; ri<SIZE; ri++)
+                for(int gi=0; gi<SIZE; gi++)
+                    for(int bi=0; bi<SIZE; bi++){
+                        RGB rgb = {(unsigned char)(ri * 255 / (SIZE-1)), (unsigned char)(gi * 255 / (SIZE-1)), (unsigned char)(bi * 255 / (SIZE-1))};
+                        t[(ri * SIZE + gi) * SIZE + bi] = nearestCode(rgb, 16, 255);
+                    }
+            return t;
+        }();
+        auto index = [](double v){
+            int i = (int)(v * (SIZE-1) + 0.5);
+            return i < 0 ? 0 : (i >= SIZE ? SIZE-1 : i);
+        };
+        return table[(index(r) * SIZE + index(g)) * SIZE + index(b)];
+    }
+
+    //16色しか出せないときの代わりの色番号(0~15はそのまま)
+    inline unsigned char toBasic16(unsigned char code){
+        static const std::vector<unsigned char> table = [](){
+            std::vector<unsigned char> t(256);
+            for(int code=0; code<256; code++) t[code] = code < 16 ? (unsigned char)code : nearestCode(rgbOf((unsigned char)code), 0, 15);
+            return t;
+        }();
+        return table[code];
+    }
+}
@@ -1,8 +1,11 @@
 #pragma once
-#include <windows.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
 
 #include <vector> // 可変長配列。CHAR_INFOの管理に便利
+#include "colorTable.hpp"
 
 namespace col{
     enum HUE : unsigned short {
@@ -15,12 +18,27 @@ namespace col{
         YELLOW  = 6, // RED | GREEN
         WHITE   = 7  // RED | GREEN | BLUE
     };
+    //色番号1バイト．0~15はhue(3bit)と強調(1bit)でWin32の属性値の下位4bitと同じ並び
+    //16~255は256色の番号(colorTable.hpp)で，256色以上を出せる端末でだけ使う
     struct COL_INF{
-        HUE hue = WHITE;
-        bool isIntensity = false;
-        COL_INF():hue(WHITE), isIntensity(false){};
-        COL_INF(HUE n, bool i):hue(n),isIntensity(i){};
+        unsigned char code;
+        COL_INF():code(WHITE){};
+        COL_INF(HUE n, bool i):code((unsigned char)(n | (i << 3))){};
+
+        static COL_INF indexed(unsigned char c){
+            COL_INF color;
+            color.code = c;
+            return color;
+        }
+        bool isExtended() const { return code >= 16; }
+        //16色として見たときの色と強調(256色の番号は近い16色にしてから)
+        HUE hue() const { return static_cast<HUE>(toBasic16(code) & 7); }
+        bool isIntensity() const { return (toBasic16(code) & 8) != 0; }
+
+        unsigned char packed() const { return code; }
+        static COL_INF unpack(unsigned char bits){ return indexed(bits); }
     };
+    //文字コード + 前景1バイト + 背景1バイト (Windowsで4バイト，wchar_tが4バイトの環境で8バイト)
     struct CHAR_INF{
         wchar_t charactor;
         COL_INF fore;
@@ -29,7 +47,28 @@ namespace col{
             : charactor(L' '), fore(WHITE, false), back(BLACK, false) {}
         CHAR_INF(wchar_t c, COL_INF f, COL_INF b)
             : charactor(c), fore(f), back(b) {}
+
+        //前景を下位8bit，背景を上位8bitにまとめた属性値
+        unsigned short attributes() const { return (unsigned short)(fore.packed() | (back.packed() << 8)); }
+        void setAttributes(unsigned short attr){
+            fore = COL_INF::unpack((unsigned char)(attr & 0xFF));
+            back = COL_INF::unpack((unsigned char)(attr >> 8));
+        }
+        bool operator==(const CHAR_INF& other) const {
+            return charactor == other.charactor && attributes() == other.attributes();
+        }
+        bool operator!=(const CHAR_INF& other) const { return !(*this == other); }
     };
+    static_assert(sizeof(COL_INF) == 1, "COL_INF must stay one byte");
+    static_assert(sizeof(CHAR_INF) <= 8, "CHAR_INF must stay within 8 bytes");
+}
+
+// vをsize個のvalueにする．確保済みの容量は縮めず，足りないときは1.5倍ずつ広げるので
+// ウィンドウをドラッグして少しずつ大きくしても，最大の大きさに達したあとは確保し直さない
+template <typename T>
+inline void assignKeepingCapacity(std::vector<T>& v, size_t size, const T& value) {
+    if (v.capacity() < size) v.reserve(std::max(size, v.capacity() + v.capacity() / 2));
+    v.assign(size, value);
 }
 
 // ScreenBufferはConsoleクラスで使う部品なので、このファイルに一緒に定義すると便利
@@ -41,147 +80,160 @@ struct ScreenBuffer {
     void reallocate(int newWidth, int newHeight) {
         width = newWidth;
         height = newHeight;
-        buffer.assign(width * height, {}); // 指定サイズでバッファを確保し、ゼロで初期化
+        assignKeepingCapacity(buffer, (size_t)width * height, col::CHAR_INF()); // 指定サイズで空白に初期化
+    }
+
+    // PlanarScreenBufferと共通のアクセサ
+    col::CHAR_INF get(int id) const { return buffer[id]; }
+    void set(int id, const col::CHAR_INF& cell) { buffer[id] = cell; }
+};
+
+// 文字と属性を別々の配列に持つScreenBuffer(構造体の配列ではなく配列の構造体)
+// 差分検出や出力変換のように片方だけを順に読む処理で使う
+struct PlanarScreenBuffer {
+    std::vector<wchar_t> chars;
+    std::vector<unsigned short> attrs;// CHAR_INF::attributes()と同じ並び
+    int width = 0;
+    int height = 0;
+
+    void reallocate(int newWidth, int newHeight) {
+        width = newWidth;
+        height = newHeight;
+        assignKeepingCapacity(chars, (size_t)width * height, L' ');
+        assignKeepingCapacity(attrs, (size_t)width * height, col::CHAR_INF().attributes());
+    }
+
+    col::CHAR_INF get(int id) const {
+        col::CHAR_INF cell;
+        cell.charactor = chars[id];
+        cell.setAttributes(attrs[id]);
+        return cell;
+    }
+    void set(int id, const col::CHAR_INF& cell) {
+        chars[id] = cell.charactor;
+        attrs[id] = cell.attributes();
     }
+
+    // ScreenBufferの内容を写す(サイズが違えば合わせる)
+    void assign(const ScreenBuffer& from) {
+        if (width != from.width || height != from.height) {
+            reallocate(from.width, from.height);
+        }
+        for (int i = 0; i < (int)from.buffer.size(); i++) {
+            chars[i] = from.buffer[i].charactor;
+            attrs[i] = from.buffer[i].attributes();
+        }
+    }
+};
+
+// 前のフレームから変わったセルの連なり(y行目の[x0,x1))
+struct DirtyRun {
+    int y;
+    int x0;
+    int x1;
 };
 
+// prevとnext(同じ大きさ)を比べて変わった連なりをrunsに入れ，変わったセルの数を返す
+// 8セルずつまとめて比べ(分岐なしで畳むのでベクトル化される)，同じブロックは中を見ない
+// gap以下の変わっていない隙間は送り直したほうが安いので，1つの連なりにつなぐ
+inline int findDirtyRuns(const PlanarScreenBuffer& prev, const PlanarScreenBuffer& next, int gap, std::vector<DirtyRun>& runs) {
+    const int BLOCK = 8;
+    const int w = next.width;
+    int changed = 0;
+    runs.clear();
+    for (int y = 0; y < next.height; y++) {
+        const wchar_t* pc = &prev.chars[y * w];
+        const wchar_t* nc = &next.chars[y * w];
+        const unsigned short* pa = &prev.attrs[y * w];
+        const unsigned short* na = &next.attrs[y * w];
+        int runStart = -1, runEnd = -1;
+        int x = 0;
+        while (x < w) {
+            if (x + BLOCK <= w) {
+                unsigned int diff = 0;
+                for (int i = 0; i < BLOCK; i++) diff |= (unsigned int)(pc[x + i] ^ nc[x + i]) | (unsigned int)(pa[x + i] ^ na[x + i]);
+                if (diff == 0) {
+                    x += BLOCK;
+                    continue;
+                }
+            }
+            int end = std::min(w, x + BLOCK);
+            for (; x < end; x++) {
+                if (pc[x] == nc[x] && pa[x] == na[x]) continue;
+                changed++;
+                if (runStart >= 0 && x - runEnd <= gap) {
+                    runEnd = x + 1;
+                } else {
+                    if (runStart >= 0) runs.push_back({ y, runStart, runEnd });
+                    runStart = x;
+                    runEnd = x + 1;
+                }
+            }
+        }
+        if (runStart >= 0) runs.push_back({ y, runStart, runEnd });
+    }
+    return changed;
+}
+
+// 端末ごとの実装 (open / getWindowSize / takeResizeEvent / present / restoreを持つConsoleBackend)
+#ifdef _WIN32
+#include "consoleWin32.hpp"
+#else
+#include "consolePosix.hpp"
+#endif
+
 class Console {
 public:
     // コンストラクタで console_init の処理を行う
     Console(){
         //console_waitKeyUP(ACTION_QUIT_GAME);
-        SetConsoleOutputCP(CP_UTF8);
-        hOriginalConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-        
-        GetConsoleMode(hOriginalConsole, &originalMode);
-        SetConsoleMode(hOriginalConsole, originalMode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
-
-        // 1. 元の画面をキャプチャ
-        CONSOLE_SCREEN_BUFFER_INFO originalCsbi;
-        GetConsoleScreenBufferInfo(hOriginalConsole, &originalCsbi);
-        originalScreen.width = originalCsbi.srWindow.Right - originalCsbi.srWindow.Left + 1;
-        originalScreen.height = originalCsbi.srWindow.Bottom - originalCsbi.srWindow.Top + 1;
-        SMALL_RECT readRegion = originalCsbi.srWindow;
-        
-        //originalScreen.buffer = (CHAR_INFO*)calloc(originalScreen.width * originalScreen.height, sizeof(CHAR_INFO));
-        originalScreen.reallocate(originalScreen.width, originalScreen.height);
-        COORD bufferSize = { (SHORT)originalScreen.width, (SHORT)originalScreen.height };
-        const COORD bufferCoord = { 0, 0 };
-        std::vector<CHAR_INFO> temp;
-        temp.assign(originalScreen.width*originalScreen.height, {});
-        ReadConsoleOutputW(hOriginalConsole, temp.data(), bufferSize, bufferCoord, &readRegion);
-        this->ConvertBufferFromPlatform(originalScreen, temp);
-
-        // 2. 代替バッファへ移行
-        printf("\x1b[?1049h\x1b[?25l");//VT100シーケンス
-        hGameConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-
-        getWindowSize(gameScreen.width, gameScreen.height, hGameConsole);
-        gameScreen.reallocate(gameScreen.width, gameScreen.height);
-        gameScreen_comberted.assign(gameScreen.width*gameScreen.height, {});
+        backend.open(originalScreen);
+
+        int width = 0, height = 0;
+        backend.getWindowSize(width, height);
+        gameScreen.reallocate(width, height);
     }
 
 
     // デストラクタで console_finish の処理を行う
     ~Console(){}
-    
-    void ConvertBufferToPlatform(std::vector<CHAR_INFO>& to, const ScreenBuffer& from){
-        if (to.size() != from.buffer.size()) {
-            to.resize(from.buffer.size());
-        }
-        for(int i=0; i<from.buffer.size(); i++){
-            WORD attributes = 0;
-            attributes |= from.buffer[i].fore.hue;
-            attributes |= (from.buffer[i].back.hue << 4);
-            if(from.buffer[i].fore.isIntensity){
-                attributes |= FOREGROUND_INTENSITY;
-            }
-            if(from.buffer[i].back.isIntensity){
-                attributes |= BACKGROUND_INTENSITY;
-            }
-            to[i].Char.UnicodeChar = from.buffer[i].charactor;
-            to[i].Attributes = attributes;
-        }
-    }
-    void ConvertBufferFromPlatform(ScreenBuffer& to, std::vector<CHAR_INFO>& from){
-        for(int i=0; i<from.size(); i++){
-            to.buffer[i].charactor = from.at(i).Char.UnicodeChar;
-            WORD attr = from.at(i).Attributes;
-            to.buffer[i].back.hue = static_cast<col::HUE>((attr & 0x00F0) >> 4);
-            to.buffer[i].fore.hue = static_cast<col::HUE>(attr & 0x000F);
-            to.buffer[i].back.isIntensity = (attr & BACKGROUND_INTENSITY) != 0;
-            to.buffer[i].fore.isIntensity = (attr & FOREGROUND_INTENSITY) != 0;
-        }
-    }
 
     // リソースを管理するクラスはコピーできないようにするのが定石
     Console(const Console&) = delete;
     Console& operator=(const Console&) = delete;
 
+    // 大きさが変わったという知らせ(SIGWINCH / WINDOW_BUFFER_SIZE_EVENT)が来ていたときだけ大きさを調べる
+    // 前のフレームから何度変わっていても，確保し直すのは1回だけ
     void checkResizeAndReallocBuffer() {
-        int currentWidth, currentHeight;
-        getWindowSize(currentWidth, currentHeight, hGameConsole);
+        if (!backend.takeResizeEvent()) return;
+        int currentWidth = gameScreen.width, currentHeight = gameScreen.height;
+        backend.getWindowSize(currentWidth, currentHeight);
         
         // 自分自身のメンバであるgameScreenを直接チェック・操作する
         if (gameScreen.width != currentWidth || gameScreen.height != currentHeight) {
             gameScreen.reallocate(currentWidth, currentHeight);
-            gameScreen_comberted.assign(gameScreen.width*gameScreen.height, {});
         }
     }
     void draw(const ScreenBuffer& screenToDraw){
-        COORD bufferSize = { (SHORT)screenToDraw.width, (SHORT)screenToDraw.height };
-        const COORD bufferCoord = { 0, 0 };
-        SMALL_RECT writeRegion = { 0, 0, (SHORT)(screenToDraw.width - 1), (SHORT)(screenToDraw.height - 1) };
-        
-        ConvertBufferToPlatform(gameScreen_comberted, gameScreen);
-        WriteConsoleOutputW(
-            hGameConsole, // 書き込み先ハンドル
-            gameScreen_comberted.data(),   // 書き込むデータ (CHAR_INFO 配列)
-            bufferSize,     // データのサイズ (幅, 高さ)
-            bufferCoord,    // データの読み取り開始位置 (0, 0)
-            &writeRegion    // コンソールへの書き込み領域
-        );
+        backend.present(screenToDraw);
     }
+    // 端末が出せる色の数(ShadingTable::buildに渡す)
+    col::ColorMode getColorMode() const { return backend.getColorMode(); }
+    // 直近のdrawで端末へ送ったバイト数
+    size_t getLastFrameBytes() const { return backend.getLastFrameBytes(); }
     
     ScreenBuffer& getGameScreenBuffer() { return gameScreen; }
     const ScreenBuffer& getOriginalScreen() const { return originalScreen; }
-    const HANDLE getGameHandle() { return hGameConsole;}
+#ifdef _WIN32
+    const HANDLE getGameHandle() { return backend.getGameHandle(); }
+#endif
 
     void restore(){
-        FlushConsoleInputBuffer(GetStdHandle(STD_INPUT_HANDLE));
-        // 元のバッファに戻す
-        printf("\x1b[?1049l");
-
-        // 【対策】復元後、カーソル位置を整える
-        // 現在のウィンドウの高さを取得
-        //CONSOLE_SCREEN_BUFFER_INFO csbi;
-        //GetConsoleScreenBufferInfo(c->hOriginalConsole, &csbi);
-        //SHORT finalHeight = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
-        
-        // カーソルをウィンドウの左下に移動させてから改行し、プロンプトがきれいな行から始まるようにする
-        //printf("\x1b[%d;1H\n", finalHeight);
-
-        // コンソールモードも元に戻す
-        SetConsoleMode(hOriginalConsole, originalMode);
+        backend.restore();
     }
 
 private:
-    void getWindowSize(int& w, int& h, HANDLE handle){
-        CONSOLE_SCREEN_BUFFER_INFO csbi;
-        if (GetConsoleScreenBufferInfo(handle, &csbi)) {
-            w = csbi.srWindow.Right - csbi.srWindow.Left + 1;
-            h = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
-        }
-    }
-
-    struct PLATFORM_INF;
-    PLATFORM_INF* platformInf;
-    HANDLE hOriginalConsole;
-    HANDLE hGameConsole;
-    DWORD originalMode;
-
+    ConsoleBackend backend;
     ScreenBuffer originalScreen;
     ScreenBuffer gameScreen;
-    std::vector<CHAR_INFO> gameScreen_comberted;
 };
-
@@ -0,0 +1,315 @@
+#pragma once
+// POSIX端末(VTシーケンス)によるConsoleの実装．console.hppから(ScreenBufferの定義のあとで)読み込む
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+
+class ConsoleBackend {
+public:
+    // 1セルあたりの最大バイト数 (SGR "\x1b[38;5;255;48;5;255m" 20バイト + UTF-8 4バイト)
+    static const int MAX_CELL_BYTES = 24;
+    // カーソル移動1回の最大バイト数 ("\x1b[65535;65535H")
+    static const int MAX_MOVE_BYTES = 14;
+    // 変わったセルがこの割合(%)以上なら差分をやめて全体を送る(連なりごとの移動のほうが高くつく)
+    static const int FULL_REPAINT_PERCENT = 50;
+    // 連なりをつなぐ隙間．色は変わったときしか送らないので，1セルなら送り直すほうがCUFより安い
+    // (広げると隙間の色が前後と違うときにSGRが増えて逆に高くつく)
+    static const int RUN_GAP = 1;
+
+    // 端末をrawモードにして代替画面へ移る
+    // 端末の中身は読み出せないので，元の画面は空白として扱う
+    // 入力(inputPosix.hpp)の読むマウスの報告とkittyのキー拡張もここで頼む．kittyの設定は画面ごとなので代替画面に移ってから
+    void open(ScreenBuffer& originalScreen){
+        SavedTerminal& saved = savedTerminal();
+        saved.hasTermios = tcgetattr(STDIN_FILENO, &saved.attrs) == 0;
+        if (saved.hasTermios) {
+            termios raw = saved.attrs;
+            raw.c_iflag &= ~(IXON | ICRNL | BRKINT | INPCK | ISTRIP);
+            raw.c_oflag &= ~(OPOST);
+            raw.c_lflag &= ~(ECHO | ICANON | IEXTEN); // ISIGは残してCtrl+Cで止められるようにする
+            raw.c_cflag |= CS8;
+            raw.c_cc[VMIN] = 0;
+            raw.c_cc[VTIME] = 0;
+            tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+        }
+        int w, h;
+        getWindowSize(w, h);
+        originalScreen.reallocate(w, h);
+        colorMode = detectColorMode();
+
+        static const char enter[] = "\x1b[?1049h\x1b[?25l";
+        writeAll(enter, sizeof(enter) - 1);
+        // マウスの移動の報告(?1003)をSGRの形式(?1006)で，キーはkittyの拡張(押した・離したを送る，
+        // 全部のキーをシーケンスにする，文字も付ける)で頼む．対応していない端末は無視する
+        static const char inputModes[] = "\x1b[?1003h\x1b[?1006h\x1b[>27u";
+        if (saved.hasTermios) writeAll(inputModes, sizeof(inputModes) - 1);
+
+        // 端末の大きさが変わったらSIGWINCHで知らせてもらう
+        resizePending() = 0;
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = onWindowChange;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        hasWinchAction = sigaction(SIGWINCH, &action, &originalWinchAction) == 0;
+
+        // Ctrl+Cやkillで止められても端末を戻す(無視する設定になっているシグナルはそのまま)
+        action.sa_handler = onTerminate;
+        action.sa_flags = 0;
+        for (int i = 0; i < STOP_SIGNAL_COUNT; i++) {
+            hasStopAction[i] = sigaction(stopSignal(i), &action, &originalStopActions[i]) == 0;
+            if (hasStopAction[i] && originalStopActions[i].sa_handler == SIG_IGN) {
+                sigaction(stopSignal(i), &originalStopActions[i], nullptr);
+                hasStopAction[i] = false;
+            }
+        }
+    }
+
+    void getWindowSize(int& w, int& h){
+        winsize ws;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 && ws.ws_row > 0) {
+            w = ws.ws_col;
+            h = ws.ws_row;
+        } else {
+            w = 80; // 端末でなければ決め打ち
+            h = 24;
+        }
+    }
+
+    // 前回呼んでから大きさが変わったか(SIGWINCHが来たか)
+    bool takeResizeEvent(){
+        if (!resizePending()) return false;
+        resizePending() = 0;
+        return true;
+    }
+
+    // 前のフレームと比べて変わった連なりだけを送る．変わったセルが多ければ全体を描き直す
+    // VTシーケンスは作り置きのバッファに並べ，同期更新(?2026)で囲んでwriteを1回だけ呼ぶ
+    // (対応していない端末は?2026を無視する)
+    void present(const ScreenBuffer& screen){
+        bool resized = screen.width != previous.width || screen.height != previous.height;
+        current.assign(screen);
+        const int total = screen.width * screen.height;
+        size_t capacity = (size_t)total * (MAX_CELL_BYTES + MAX_MOVE_BYTES) + 64;
+        if (out.size() < capacity) out.resize(capacity);
+        char* p = out.data();
+        p = append(p, "\x1b[?2026h");
+        char* body = p;
+        int attrState = -1; // 端末の今の色(属性値)．フレームの始めは分からないので必ず送る
+
+        int changed = (resized || !hasPrevious) ? total : findDirtyRuns(previous, current, RUN_GAP, runs);
+        if (resized || !hasPrevious || changed * 100 >= total * FULL_REPAINT_PERCENT) {
+            if (resized) p = append(p, "\x1b[2J");
+            p = append(p, "\x1b[H");
+            for (int y = 0; y < screen.height; y++) {
+                if (y > 0) p = append(p, "\r\n"); // 右端での折り返しに頼らず行を送る
+                p = appendCells(p, current, y * screen.width, (y + 1) * screen.width, attrState, colorMode);
+            }
+        } else {
+            int cursorX = -1, cursorY = -1;
+            for (size_t i = 0; i < runs.size(); i++) {
+                const DirtyRun& run = runs[i];
+                p = appendMove(p, cursorX, cursorY, run.x0, run.y);
+                p = appendCells(p, current, run.y * screen.width + run.x0, run.y * screen.width + run.x1, attrState, colorMode);
+                cursorX = run.x1; // 右端まで書いたときはwidthになり，同じ行の中へは動かさない
+                cursorY = run.y;
+            }
+        }
+        if (p == body) {
+            lastFrameBytes = 0; // 変わったセルがなければ何も送らない
+        } else {
+            p = append(p, "\x1b[?2026l");
+            writeAll(out.data(), p - out.data());
+            lastFrameBytes = p - out.data();
+        }
+
+        std::swap(previous, current);
+        hasPrevious = true;
+    }
+
+    size_t getLastFrameBytes() const { return lastFrameBytes; }
+
+    void restore(){
+        for (int i = 0; i < STOP_SIGNAL_COUNT; i++) {
+            if (hasStopAction[i]) sigaction(stopSignal(i), &originalStopActions[i], nullptr);
+            hasStopAction[i] = false;
+        }
+        leaveTerminal();
+        if (hasWinchAction) sigaction(SIGWINCH, &originalWinchAction, nullptr);
+    }
+
+    // col::HUEはWin32の並び(B=1,G=2,R=4)なので，ANSIの並び(R=1,G=2,B=4)に入れ替える
+    static int ansiColor(int hue){
+        return ((hue & 1) << 2) | (hue & 2) | ((hue & 4) >> 2);
+    }
+
+    col::ColorMode getColorMode() const { return colorMode; }
+
+    // screen[begin,end)のセルを並べる．色はattrStateと違うときだけ送り，attrStateを更新する
+    static char* appendCells(char* p, const PlanarScreenBuffer& screen, int begin, int end, int& attrState, col::ColorMode mode){
+        for (int i = begin; i < end; i++) {
+            unsigned short attr = screen.attrs[i];
+            if (attr != attrState) {
+                p = appendSgr(p, attr, attrState, mode);
+                attrState = attr;
+            }
+            p = appendUtf8(p, screen.chars[i]);
+        }
+        return p;
+    }
+    // (cursorX,cursorY)から(x,y)へ動かす．同じ行の右ならCUF，次の行の先頭なら改行，それ以外はCUP
+    static char* appendMove(char* p, int cursorX, int cursorY, int x, int y){
+        if (y == cursorY && x == cursorX) return p;
+        if (y == cursorY && x > cursorX && cursorX >= 0) {
+            p = append(p, "\x1b[");
+            p = appendInt(p, x - cursorX);
+            return append(p, "C");
+        }
+        if (y == cursorY + 1 && x == 0 && cursorY >= 0) return append(p, "\r\n");
+        p = append(p, "\x1b[");
+        p = appendInt(p, y + 1);
+        *p++ = ';';
+        p = appendInt(p, x + 1);
+        return append(p, "H");
+    }
+
+    static char* append(char* p, const char* s){
+        while (*s) *p++ = *s++;
+        return p;
+    }
+    // attrの色にするSGR．前景・背景のうちprevState(負なら不明)から変わったほうだけを書く
+    static char* appendSgr(char* p, unsigned short attr, int prevState, col::ColorMode mode){
+        bool foreChanged = prevState < 0 || ((attr ^ prevState) & 0x00FF) != 0;
+        bool backChanged = prevState < 0 || ((attr ^ prevState) & 0xFF00) != 0;
+        *p++ = '\x1b';
+        *p++ = '[';
+        if (foreChanged) p = appendColor(p, (unsigned char)(attr & 0xFF), false, mode);
+        if (foreChanged && backChanged) *p++ = ';';
+        if (backChanged) p = appendColor(p, (unsigned char)(attr >> 8), true, mode);
+        *p++ = 'm';
+        return p;
+    }
+    // 色番号1つ分のSGRの引数．0~15は16色の指定，それ以外は256色の指定(16色の端末なら近い色に置き換える)
+    // セルが持つのは256色の番号なので，24bitの端末にもRGB(38;2;r;g;b)ではなく短い番号のまま送る
+    static char* appendColor(char* p, unsigned char code, bool isBack, col::ColorMode mode){
+        if (code >= 16 && mode == col::ColorMode::Basic16) code = col::toBasic16(code);
+        if (code < 16) {
+            int base = (code & 8) ? (isBack ? 100 : 90) : (isBack ? 40 : 30);
+            return appendInt(p, base + ansiColor(code & 7));
+        }
+        p = append(p, isBack ? "48;5;" : "38;5;");
+        return appendInt(p, code);
+    }
+    static char* appendInt(char* p, int v){
+        char digits[12];
+        int n = 0;
+        do { digits[n++] = (char)('0' + v % 10); v /= 10; } while (v > 0);
+        while (n > 0) *p++ = digits[--n];
+        return p;
+    }
+    static char* appendUtf8(char* p, wchar_t wc){
+        unsigned int c = (unsigned int)wc;
+        if (c < 0x20 || c == 0x7F) c = ' '; // 制御文字はそのまま送らない
+        if (c < 0x80) {
+            *p++ = (char)c;
+        } else if (c < 0x800) {
+            *p++ = (char)(0xC0 | (c >> 6));
+            *p++ = (char)(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            *p++ = (char)(0xE0 | (c >> 12));
+            *p++ = (char)(0x80 | ((c >> 6) & 0x3F));
+            *p++ = (char)(0x80 | (c & 0x3F));
+        } else {
+            *p++ = (char)(0xF0 | (c >> 18));
+            *p++ = (char)(0x80 | ((c >> 12) & 0x3F));
+            *p++ = (char)(0x80 | ((c >> 6) & 0x3F));
+            *p++ = (char)(0x80 | (c & 0x3F));
+        }
+        return p;
+    }
+
+private:
+    // COLORTERMとTERMから端末の色数を決める
+    static col::ColorMode detectColorMode(){
+        const char* colorTerm = getenv("COLORTERM");
+        if (colorTerm && (strcmp(colorTerm, "truecolor") == 0 || strcmp(colorTerm, "24bit") == 0)) return col::ColorMode::TrueColor;
+        const char* term = getenv("TERM");
+        if (term && strstr(term, "256color")) return col::ColorMode::Xterm256;
+        return col::ColorMode::Basic16;
+    }
+
+    // 端末を戻してから終わらせるシグナル
+    static const int STOP_SIGNAL_COUNT = 4;
+    static int stopSignal(int i){
+        static const int signals[STOP_SIGNAL_COUNT] = {SIGINT, SIGTERM, SIGHUP, SIGQUIT};
+        return signals[i];
+    }
+
+    // シグナルハンドラからも戻せるように，元の端末の設定はオブジェクトの外に置く
+    struct SavedTerminal {
+        termios attrs;
+        bool hasTermios;
+    };
+    static SavedTerminal& savedTerminal(){
+        static SavedTerminal saved = {};
+        return saved;
+    }
+
+    // 入力の設定，色，カーソル，代替画面，rawモードの順に戻す．シグナルハンドラから呼んでよい関数だけを使う
+    static void leaveTerminal(){
+        static const char inputModes[] = "\x1b[<u\x1b[?1006l\x1b[?1003l";
+        static const char leave[] = "\x1b[0m\x1b[?25h\x1b[?1049l";
+        const SavedTerminal& saved = savedTerminal();
+        if (saved.hasTermios) writeAll(inputModes, sizeof(inputModes) - 1);
+        writeAll(leave, sizeof(leave) - 1);
+        if (saved.hasTermios) tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved.attrs);
+    }
+
+    // 端末を戻してから既定の動作(終了)に戻してもう一度送る．ハンドラを抜けたところで届いて終わる
+    static void onTerminate(int sig){
+        leaveTerminal();
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = SIG_DFL;
+        sigemptyset(&action.sa_mask);
+        sigaction(sig, &action, nullptr);
+        raise(sig);
+    }
+
+    // シグナルハンドラから書くので sig_atomic_t (定数で初期化されるので関数内のstaticでも安全)
+    static volatile sig_atomic_t& resizePending(){
+        static volatile sig_atomic_t pending = 0;
+        return pending;
+    }
+    static void onWindowChange(int){ resizePending() = 1; }
+
+    // 書ききるまで繰り返す(端末が遅いと一部しか書けないことがある)
+    static void writeAll(const char* data, size_t size){
+        while (size > 0) {
+            ssize_t n = write(STDOUT_FILENO, data, size);
+            if (n < 0) {
+                if (errno == EINTR || errno == EAGAIN) continue;
+                return;
+            }
+            data += n;
+            size -= (size_t)n;
+        }
+    }
+
+    col::ColorMode colorMode = col::ColorMode::Basic16;
+    struct sigaction originalWinchAction;
+    bool hasWinchAction = false;
+    struct sigaction originalStopActions[STOP_SIGNAL_COUNT];
+    bool hasStopAction[STOP_SIGNAL_COUNT] = {};
+    std::vector<char> out; // VT出力用(最大サイズで確保して使い回す)
+    PlanarScreenBuffer previous; // 直前に送ったフレーム
+    PlanarScreenBuffer current;
+    bool hasPrevious = false;
+    std::vector<DirtyRun> runs;
+    size_t lastFrameBytes = 0;
+};
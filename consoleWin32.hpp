@@ -0,0 +1,164 @@
+#pragma once
+// Win32コンソールAPIによるConsoleの実装．console.hppから(ScreenBufferの定義のあとで)読み込む
+#include <windows.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <vector>
+#include "input.hpp"
+
+class ConsoleBackend {
+public:
+    // 元の画面を読み取ってから代替バッファへ移る
+    void open(ScreenBuffer& originalScreen){
+        SetConsoleOutputCP(CP_UTF8);
+        hOriginalConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+
+        GetConsoleMode(hOriginalConsole, &originalMode);
+        SetConsoleMode(hOriginalConsole, originalMode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+
+        // 1. 元の画面をキャプチャ
+        CONSOLE_SCREEN_BUFFER_INFO originalCsbi;
+        GetConsoleScreenBufferInfo(hOriginalConsole, &originalCsbi);
+        originalScreen.width = originalCsbi.srWindow.Right - originalCsbi.srWindow.Left + 1;
+        originalScreen.height = originalCsbi.srWindow.Bottom - originalCsbi.srWindow.Top + 1;
+        SMALL_RECT readRegion = originalCsbi.srWindow;
+
+        originalScreen.reallocate(originalScreen.width, originalScreen.height);
+        COORD bufferSize = { (SHORT)originalScreen.width, (SHORT)originalScreen.height };
+        const COORD bufferCoord = { 0, 0 };
+        std::vector<CHAR_INFO> temp;
+        temp.assign(originalScreen.width*originalScreen.height, {});
+        ReadConsoleOutputW(hOriginalConsole, temp.data(), bufferSize, bufferCoord, &readRegion);
+        ConvertBufferFromPlatform(originalScreen, temp);
+
+        // 2. 代替バッファへ移行
+        printf("\x1b[?1049h\x1b[?25l");//VT100シーケンス
+        hGameConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+
+        // 3. 大きさの変更を入力イベント(WINDOW_BUFFER_SIZE_EVENT)で受け取る
+        hInput = GetStdHandle(STD_INPUT_HANDLE);
+        GetConsoleMode(hInput, &originalInputMode);
+        SetConsoleMode(hInput, originalInputMode | ENABLE_WINDOW_INPUT);
+    }
+
+    void getWindowSize(int& w, int& h){
+        CONSOLE_SCREEN_BUFFER_INFO csbi;
+        if (GetConsoleScreenBufferInfo(hGameConsole, &csbi)) {
+            w = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+            h = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+        }
+    }
+
+    // 前回呼んでから大きさの変更イベントが来たか
+    // 入力キューを読むのはInputBackendだけにして(キーの順番を崩さない)，読んだときに見つけた分を受け取る
+    bool takeResizeEvent(){
+        return InputBackend::get().takeResizeEvent();
+    }
+
+    void present(const ScreenBuffer& screenToDraw){
+        COORD bufferSize = { (SHORT)screenToDraw.width, (SHORT)screenToDraw.height };
+        const COORD bufferCoord = { 0, 0 };
+        SMALL_RECT writeRegion = { 0, 0, (SHORT)(screenToDraw.width - 1), (SHORT)(screenToDraw.height - 1) };
+
+        ConvertBufferToPlatform(gameScreen_comberted, screenToDraw);
+        WriteConsoleOutputW(
+            hGameConsole, // 書き込み先ハンドル
+            gameScreen_comberted.data(),   // 書き込むデータ (CHAR_INFO 配列)
+            bufferSize,     // データのサイズ (幅, 高さ)
+            bufferCoord,    // データの読み取り開始位置 (0, 0)
+            &writeRegion    // コンソールへの書き込み領域
+        );
+        lastFrameBytes = gameScreen_comberted.size() * sizeof(CHAR_INFO);
+    }
+
+    size_t getLastFrameBytes() const { return lastFrameBytes; }
+
+    void restore(){
+        FlushConsoleInputBuffer(GetStdHandle(STD_INPUT_HANDLE));
+        // 元のバッファに戻す
+        printf("\x1b[?1049l");
+
+        // 【対策】復元後、カーソル位置を整える
+        // 現在のウィンドウの高さを取得
+        //CONSOLE_SCREEN_BUFFER_INFO csbi;
+        //GetConsoleScreenBufferInfo(c->hOriginalConsole, &csbi);
+        //SHORT finalHeight = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+
+        // カーソルをウィンドウの左下に移動させてから改行し、プロンプトがきれいな行から始まるようにする
+        //printf("\x1b[%d;1H\n", finalHeight);
+
+        // コンソールモードも元に戻す
+        SetConsoleMode(hOriginalConsole, originalMode);
+        SetConsoleMode(hInput, originalInputMode);
+    }
+
+    HANDLE getGameHandle() const { return hGameConsole; }
+
+    // WriteConsoleOutputWは属性値で色を指定するので16色まで
+    col::ColorMode getColorMode() const { return col::ColorMode::Basic16; }
+
+    // CHAR_INFとCHAR_INFOはどちらも4バイトで，文字(2バイト)のあとに属性が続く
+    // 色番号0~15なら前景・背景のバイトから下位4bitずつ取り出してWORDに詰めるだけ
+    // 2セルを64bitにまとめて分岐なしで変換する(ベクトル化できるコンパイラではさらに広がる)
+    // 256色の番号(256色の端末で録ったものを再生したときなど)が混じっていれば，先に近い16色にする
+    static_assert(sizeof(col::CHAR_INF) == 4 && sizeof(CHAR_INFO) == 4, "cells must be 4 bytes on Win32");
+    static_assert(offsetof(col::CHAR_INF, fore) == 2 && offsetof(col::CHAR_INF, back) == 3, "unexpected CHAR_INF layout");
+
+    static uint64_t toPlatformCells(uint64_t cells){
+        const uint64_t CHARS = 0x0000FFFF0000FFFFull, NIBBLE = 0x0000000F0000000Full;
+        const uint64_t EXTENDED = 0xF0F00000F0F00000ull; // 色のバイトの上位4bit
+        if (cells & EXTENDED) cells = toBasic16Cells(cells);
+        return (cells & CHARS) | (((cells >> 16) & NIBBLE) << 16) | (((cells >> 24) & NIBBLE) << 20);
+    }
+    static uint64_t fromPlatformCells(uint64_t cells){
+        const uint64_t CHARS = 0x0000FFFF0000FFFFull, NIBBLE = 0x0000000F0000000Full;
+        return (cells & CHARS) | (((cells >> 16) & NIBBLE) << 16) | (((cells >> 20) & NIBBLE) << 24);
+    }
+
+    void ConvertBufferToPlatform(std::vector<CHAR_INFO>& to, const ScreenBuffer& from){
+        if (to.size() != from.buffer.size()) {
+            to.resize(from.buffer.size());
+        }
+        convertCells(to.data(), from.buffer.data(), from.buffer.size(), toPlatformCells);
+    }
+    void ConvertBufferFromPlatform(ScreenBuffer& to, const std::vector<CHAR_INFO>& from){
+        convertCells(to.buffer.data(), from.data(), from.size(), fromPlatformCells);
+    }
+
+private:
+    // 2セル分の前景・背景の色番号を，それぞれcol::toBasic16で16色にする
+    static uint64_t toBasic16Cells(uint64_t cells){
+        static const int COLOR_SHIFTS[4] = {16, 24, 48, 56};
+        for (int i = 0; i < 4; i++) {
+            unsigned char code = (unsigned char)(cells >> COLOR_SHIFTS[i]);
+            cells = (cells & ~(0xFFull << COLOR_SHIFTS[i])) | ((uint64_t)col::toBasic16(code) << COLOR_SHIFTS[i]);
+        }
+        return cells;
+    }
+
+    // 4バイトのセルをcount個，2個ずつconvertに通す(端数の1個は上位を0にして通す)
+    template <typename To, typename From>
+    static void convertCells(To* dest, const From* src, size_t count, uint64_t (*convert)(uint64_t)){
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            uint64_t cells;
+            memcpy(&cells, &src[i], 8);
+            cells = convert(cells);
+            memcpy((void*)&dest[i], &cells, 8);
+        }
+        if (i < count) {
+            uint32_t cell;
+            memcpy(&cell, &src[i], 4);
+            cell = (uint32_t)convert(cell);
+            memcpy((void*)&dest[i], &cell, 4);
+        }
+    }
+
+    HANDLE hOriginalConsole;
+    HANDLE hGameConsole;
+    DWORD originalMode;
+    HANDLE hInput;
+    DWORD originalInputMode;
+    std::vector<CHAR_INFO> gameScreen_comberted;
+    size_t lastFrameBytes = 0;
+};
@@ -1,8 +1,9 @@
 #pragma once
 #include "vec.hpp"
 #include "math.h"
-#include "windows.h"
 #include "console.hpp"
+#include <vector>
+#include <algorithm>
 namespace design
 {
     //0で範囲外
@@ -13,13 +14,43 @@ namespace design
         }
         return 0;
     }
+    //リングの内側(ポータルの先が見える部分)
+    bool portalWindow(vec::vec2 uv){
+        return uv.length() <= 0.3;
+    }
+
+    //壁番号(縄張り)ごとの色．変更したらShadingTable::buildし直す
+    struct Palette{
+        static const int MAX_WALL_ID = 5;
+        col::HUE wall[MAX_WALL_ID+1] = {col::RED, col::BLUE, col::BLUE, col::BLUE, col::BLUE, col::BLUE};
+    };
 
-    col::CHAR_INF map(int numFlag, int sideFlag){
+    //霧へのなじませ．level 0:そのまま 1~3:だんだん暗く
+    //背景が黒いもの(天井など)は文字を細くし，色のあるものは黒い網掛け文字を重ねる
+    col::CHAR_INF fogBlend(col::CHAR_INF cell, int level){
+        static const wchar_t shadeChars[] = {L'░', L'▒', L'▓'};
+        static const wchar_t thinChars[] = {L'+', L':', L'.'};
+        if(level <= 0) return cell;
+        if(level > 3) level = 3;
+        if(cell.back.hue() == col::BLACK && !cell.back.isIntensity()){
+            if(cell.charactor != L' ') cell.charactor = thinChars[level-1];
+        }else{
+            cell.charactor = shadeChars[level-1];
+            cell.fore = {col::BLACK, false};
+        }
+        return cell;
+    }
+
+    col::CHAR_INF map(int numFlag, int sideFlag, const Palette &palette){
         col::CHAR_INF result;
         col::COL_INF backCol;
-        WCHAR s = L' ';
+        wchar_t s = L' ';
         {
             switch (numFlag) {
+                case -3://霧(視界の外)
+                    backCol = {col::BLACK, false};
+                    s=L' ';
+                    break;
                 case -1://天井
                     backCol = {col::BLACK, false}; //black
                     s=L'#';
@@ -35,14 +66,14 @@ namespace design
                 case 5:
                     s=L'P';
                     if(sideFlag==1)
-                        backCol = {col::BLUE, true};
+                        backCol = {palette.wall[numFlag], true};
                     else
-                        backCol = {col::BLUE, false};
+                        backCol = {palette.wall[numFlag], false};
                     break;
 
                 default:
                     //デバッグ用
-                    backCol.hue = col::RED;
+                    backCol = {col::RED, false};
                     break;
             }
         }
@@ -51,6 +82,94 @@ namespace design
         return result;
     }
 
+    //(明るさ, オブジェクト番号, 面, 距離段階)から完成したセルを引く表
+    //mapの分岐を起動時とパレット変更時にだけ行い，描画ループは添字計算と読み込みだけにする
+    //距離段階は0~viewDistanceを分割したもので，fogStartより先は霧になじませる
+    //焼き込んだ明るさが1段暗いごとに霧の段階を1つ進める
+    //256色以上を出せる端末では，網掛け文字の代わりに色そのものをRGBで連続的に暗くし
+    //量子化の表(col::quantize)で色番号にしておく．どちらでも描画時の手間は表を引くだけ
+    class ShadingTable{
+    public:
+        static const int LIGHT_LEVELS = 3;//lighting::LightMap::LEVELSと同じ
+        static const int DEPTH_BUCKETS = 16;
+        static const int MIN_OBJECT_ID = -3;//霧
+        static const int OBJECT_SLOTS = Palette::MAX_WALL_ID - MIN_OBJECT_ID + 2;//最後の枠は範囲外(デバッグ用)
+
+        ShadingTable(){ build(Palette()); }
+
+        void build(const Palette &newPalette, double newViewDistance = 12.0, double newFogStart = 3.0,
+                col::ColorMode newColorMode = col::ColorMode::Basic16){
+            palette = newPalette;
+            colorMode = newColorMode;
+            viewDistance = newViewDistance;
+            fogStart = std::min(newFogStart, newViewDistance);
+            bucketScale = DEPTH_BUCKETS / viewDistance;
+            for(int light=0; light<LIGHT_LEVELS; light++){
+                for(int slot=0; slot<OBJECT_SLOTS; slot++){
+                    int objectID = (slot == OBJECT_SLOTS-1) ? 0 : slot + MIN_OBJECT_ID;
+                    for(int side=0; side<2; side++){
+                        col::CHAR_INF base = map(objectID, side, palette);
+                        for(int bucket=0; bucket<DEPTH_BUCKETS; bucket++){
+                            int darkness = LIGHT_LEVELS-1 - light;
+                            cells[index(light, slot, side, bucket)] = (colorMode == col::ColorMode::Basic16)
+                                ? fogBlend(base, fogLevel(bucket) + darkness)
+                                : dim(base, brightness(bucket, light));
+                        }
+                    }
+                }
+            }
+        }
+        const Palette& getPalette() const { return palette; }
+        col::ColorMode getColorMode() const { return colorMode; }
+        double getViewDistance() const { return viewDistance; }
+        double getFogStart() const { return fogStart; }
+
+        const col::CHAR_INF& lookup(int objectID, int side, double distance, int light = LIGHT_LEVELS-1) const {
+            int slot = objectID - MIN_OBJECT_ID;
+            if(slot < 0 || slot >= OBJECT_SLOTS-1) slot = OBJECT_SLOTS-1;
+            int bucket = (int)(distance * bucketScale);
+            if(bucket >= DEPTH_BUCKETS) bucket = DEPTH_BUCKETS-1;
+            if(bucket < 0) bucket = 0;
+            if(light < 0) light = 0;
+            if(light >= LIGHT_LEVELS) light = LIGHT_LEVELS-1;
+            return cells[index(light, slot, side & 1, bucket)];
+        }
+
+    private:
+        static int index(int light, int slot, int side, int bucket){
+            return ((light*OBJECT_SLOTS + slot)*2 + side)*DEPTH_BUCKETS + bucket;
+        }
+        //段階の中央の距離がfogStart~viewDistanceのどこにあるかで1~3
+        int fogLevel(int bucket) const {
+            double d = (bucket + 0.5) / bucketScale;
+            if(d < fogStart || viewDistance <= fogStart) return 0;
+            return 1 + std::min(2, (int)((d - fogStart) / (viewDistance - fogStart) * 3));
+        }
+        //段階の中央の距離と焼き込んだ明るさからの明るさ(0~1)．fogStartから先は霧(黒)へ線形に近づく
+        double brightness(int bucket, int light) const {
+            double d = (bucket + 0.5) / bucketScale;
+            double fog = (viewDistance <= fogStart) ? 0.0 : (d - fogStart) / (viewDistance - fogStart);
+            fog = std::min(1.0, std::max(0.0, fog));
+            double lit = 0.55 + 0.45 * light / (LIGHT_LEVELS-1);
+            return (1.0 - fog) * lit;
+        }
+        static col::COL_INF dim(col::COL_INF color, double amount){
+            col::RGB rgb = col::rgbOf(color.code);
+            return col::COL_INF::indexed(col::quantize(rgb.r / 255.0 * amount, rgb.g / 255.0 * amount, rgb.b / 255.0 * amount));
+        }
+        static col::CHAR_INF dim(col::CHAR_INF cell, double amount){
+            cell.fore = dim(cell.fore, amount);
+            cell.back = dim(cell.back, amount);
+            return cell;
+        }
+        Palette palette;
+        col::ColorMode colorMode = col::ColorMode::Basic16;
+        double viewDistance;
+        double fogStart;
+        double bucketScale;
+        col::CHAR_INF cells[LIGHT_LEVELS*OBJECT_SLOTS*2*DEPTH_BUCKETS];
+    };
+
     double hash_1d(double n){
         return floor(sin(n*542.323)*3245.6453);
     }
@@ -70,22 +189,55 @@ namespace design
     //     }
     // }
 
-    void dissolveAnimation(double x, double y, double progress, col::CHAR_INF *dest, col::CHAR_INF *from, col::CHAR_INF *to){
-        float threshold = (rand() % 100) / 100.0f;
-        if(threshold*0.5 < progress){
-            dest->charactor = (hash_2d(x,y)>0.5) ? L'0' : L'1';
-            if(threshold*0.75 < progress){
-                dest->back = from->back;
-                dest->fore = dest->fore;
-            }
-            else{
-                dest->back = to->back;
-                dest->fore = to->fore;
+    //ディゾルブ用のしきい値とノイズ．解像度が変わったときだけ作り直す
+    struct DissolveMask{
+        std::vector<unsigned char> threshold;//0~99
+        std::vector<unsigned char> noise;//bit0:文字'1' bit1:背景の強調
+        int width = 0;
+        int height = 0;
+
+        void build(int w, int h){
+            if(w == width && h == height) return;
+            width = w;
+            height = h;
+            threshold.resize(w*h);
+            noise.resize(w*h);
+            for(int y=0; y<h; y++){
+                for(int x=0; x<w; x++){
+                    double u = (double)x/w;
+                    double v = (double)y/h;
+                    int id = x+y*w;
+                    threshold[id] = (unsigned char)(rand() % 100);
+                    noise[id] = (hash_2d(u,v)>0.5 ? 1 : 0) | (hash_2d(v,u)>0.5 ? 2 : 0);
+                }
             }
-            dest->back = {col::GREEN, (hash_2d(y,x)>0.5)};
-            if(threshold*0.9 < progress){
+        }
+    };
+
+    //進捗から求める各段階のしきい値(threshold*k < progress を整数比較にしたもの)
+    struct DissolveCutoff{
+        int noise;//ノイズ表示開始
+        int fore;//前景色の切り替え
+        int swap;//遷移先に置き換え
+    };
+    DissolveCutoff dissolveCutoff(double progress){
+        DissolveCutoff c;
+        c.noise = (int)ceil(progress*100/0.5);
+        c.fore = (int)ceil(progress*100/0.75);
+        c.swap = (int)ceil(progress*100/0.9);
+        return c;
+    }
+
+    void dissolveAnimation(unsigned char threshold, unsigned char noise, const DissolveCutoff &cutoff,
+            col::CHAR_INF *dest, const col::CHAR_INF *from, const col::CHAR_INF *to){
+        if(threshold < cutoff.noise){
+            if(threshold < cutoff.swap){
                 *dest = *to;
+                return;
             }
+            dest->charactor = (noise & 1) ? L'0' : L'1';
+            dest->fore = (threshold < cutoff.fore) ? from->fore : to->fore;
+            dest->back = {col::GREEN, (noise & 2) != 0};
         }else{
             *dest = *from;
         }
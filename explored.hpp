@@ -0,0 +1,84 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "maze.hpp"
+
+//一度でも画面に映ったマス(探索済み)の記録
+namespace explore
+{
+    //迷路と同じ大きさのビット列．描画中はスレッドごとの書き込み用ビット列に印を付け
+    //フレームの終わりに一度だけ本体へまとめる(書き込み側は排他も原子操作もいらない)
+    class ExploredMap{
+    public:
+        //フレームの始めに呼ぶ．迷路が変わっていたら記録を消す
+        void beginFrame(const maze::Maze *map, int threadCount = 1){
+            bool resized = map != owner || map->getWidth() != width || map->getHeight() != height;
+            if(resized){
+                owner = map;
+                width = map->getWidth();
+                height = map->getHeight();
+                words = (width * height + 63) / 64;
+                bits.assign(words, 0);
+                revision++;
+            }
+            if(resized || (int)frames.size() != threadCount){
+                frames.assign(threadCount, FrameMarks());
+                for(size_t t=0; t<frames.size(); t++) frames[t].bits.assign(words, 0);
+            }
+        }
+
+        //thread番目の書き込み用ビット列に(x,y)の印を付ける
+        void mark(int thread, int x, int y){
+            if(x < 0 || x >= width || y < 0 || y >= height) return;
+            int id = y * width + x;
+            FrameMarks &frame = frames[thread];
+            uint64_t &word = frame.bits[id / 64];
+            if(word == 0) frame.dirty.push_back(id / 64);
+            word |= (uint64_t)1 << (id % 64);
+        }
+
+        //書き込み用ビット列を本体へまとめて空に戻す．新しく探索済みになったマスがあればtrue
+        //印を付けた単語だけを見るので，迷路が大きくても手間は印の数で決まる
+        bool endFrame(){
+            bool changed = false;
+            for(size_t t=0; t<frames.size(); t++){
+                FrameMarks &frame = frames[t];
+                for(size_t i=0; i<frame.dirty.size(); i++){
+                    int w = frame.dirty[i];
+                    uint64_t added = frame.bits[w] & ~bits[w];
+                    if(added){
+                        bits[w] |= added;
+                        changed = true;
+                    }
+                    frame.bits[w] = 0;
+                }
+                frame.dirty.clear();
+            }
+            if(changed) revision++;
+            return changed;
+        }
+
+        bool isExplored(int x, int y) const {
+            if(x < 0 || x >= width || y < 0 || y >= height) return false;
+            int id = y * width + x;
+            return ((bits[id / 64] >> (id % 64)) & 1) != 0;
+        }
+        //探索済みのマスが増えるか迷路が変わるたびに増える(ミニマップの作り直し判定用)
+        unsigned int getRevision() const { return revision; }
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+
+    private:
+        const maze::Maze *owner = nullptr;
+        int width = 0;
+        int height = 0;
+        int words = 0;
+        std::vector<uint64_t> bits;
+        struct FrameMarks{
+            std::vector<uint64_t> bits;
+            std::vector<int> dirty;//このフレームで0でなくなった単語
+        };
+        std::vector<FrameMarks> frames;
+        unsigned int revision = 0;
+    };
+}
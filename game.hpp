@@ -4,8 +4,13 @@
 #include "console.hpp"
 #include "player.hpp"
 #include <time.h>
+#include <stdlib.h>
+#include <chrono>
 #include "maze.hpp"
 #include "render.hpp"
+#include "visibility.hpp"
+#include "minimap.hpp"
+#include "presenter.hpp"
 #include "testCommand/shellGame.hpp"
 #include "shellTextEditer.hpp"
 
@@ -21,35 +26,63 @@ class Game{
 private:
     // システム関連
     Console console;
+    record::Recorder recorder;    // 環境変数MAZE_RECORDがあれば，そのファイルへ画面を記録する
+    present::Presenter presenter; // consoleへの書き出しは別スレッドで行う
     InputManager inputManager;
-    LARGE_INTEGER freq, lastTime, currentTime;
+    std::chrono::steady_clock::time_point lastTime, currentTime;
     double deltaTime;
     double FPS;
 
     // ゲームオブジェクト
     Player player;
     maze::Maze map;
+    visibility::PVS pvs; // マスごとの見える可能性のあるマス(ポータルなどの描画を省く)
+    maze::Maze nextMap;  // ポータルの先の階
+    render::PortalTarget portalTarget;
+    explore::ExploredMap explored; // 画面に映ったことのあるマス
+    minimap::Minimap minimap;
+    bool showMinimap;
     vec::vec3 portalPos;
     vec::vec3 portalNormal;
+    render::RenderContext renderContext;
 
     // ゲームの状態
     GameState currentState;
     double animationFrame; // アニメーションのフレーム管理用
     double animationSpeed;
+    ScreenBuffer transitionScreen; // アニメーション中は静止しているゲーム画面を一度だけ描画して使い回す
+    design::DissolveMask dissolveMask;
 
     // シェル
     ShellGame sgame;
-    shellTextEditer shellTextEditer;
+    shellTextEditer shellEditor;
     std::vector<std::string> shellLog;
 
     void waitFPS(){//時間処理
         do{
-            QueryPerformanceCounter(&currentTime);
-            deltaTime = (double)(currentTime.QuadPart - lastTime.QuadPart) / freq.QuadPart;
+            currentTime = std::chrono::steady_clock::now();
+            deltaTime = std::chrono::duration<double>(currentTime - lastTime).count();
         }while(deltaTime < 1.0/FPS);
     }
+
+    //遷移アニメーション用のゲーム画面とマスクを用意(開始時とリサイズ時のみ)
+    void prepareTransition(){
+        const ScreenBuffer& gameScreen = console.getGameScreenBuffer();
+        transitionScreen.reallocate(gameScreen.width, gameScreen.height);
+        render::setBuffer(&renderContext, &player, &map, &transitionScreen, portalPos, portalNormal, portalVisible(), &portalTarget);
+        dissolveMask.build(gameScreen.width, gameScreen.height);
+    }
+    //プレイヤーのいるマスからポータルのマスが見える可能性があるか
+    bool portalVisible(){
+        pvs.update(&map);//壁が壊されただけなら周りだけ直す
+        return pvs.isVisible(player.getPos(), portalPos);
+    }
+    bool transitionNeedsResize(){
+        const ScreenBuffer& gameScreen = console.getGameScreenBuffer();
+        return transitionScreen.width != gameScreen.width || transitionScreen.height != gameScreen.height;
+    }
 public:
-    Game() : shellTextEditer(sgame){
+    Game() : shellEditor(sgame){
         //初期数値
         const double defaultFPS = 30.0;
         const int mapSizeX = 5;
@@ -62,6 +95,8 @@ public:
         const double playerMoveSpeed = 2.;
         const double playerRotSpeed = 0.9;
         const double animationDefaultSpeed = 4.0/200.;
+        const double viewDistance = 12.0;      // これより先は霧
+        const double fogStartDistance = 3.0;   // ここから霧になじませ始める
 
         //console.init(&console);
         
@@ -69,8 +104,7 @@ public:
         //時間処理の用意
         FPS = defaultFPS;
         deltaTime = 0;
-        QueryPerformanceFrequency(&freq);//タイマーの周波数
-        QueryPerformanceCounter(&lastTime);//基準時間
+        lastTime = std::chrono::steady_clock::now();//基準時間
 
         //ゴールポータルの設定
         portalPos = portaldefaultPos;   // ポータルの中心座標
@@ -79,6 +113,15 @@ public:
 
         //マップ用意
         map.generate(mapSizeX, mapSizeY);
+        pvs.build(&map);
+        nextMap.generate(mapSizeX, mapSizeY);
+        portalTarget.map = &nextMap;
+        portalTarget.pos = playerStartPos;//次の階のスタート地点に出る
+        portalTarget.forward = {0.0, 0.0, 1.0};
+        vec::rotate(portalTarget.forward.x, portalTarget.forward.z, playerStartDirX);
+        renderContext.explored = &explored;
+        showMinimap = true;
+        renderContext.shading.build(renderContext.shading.getPalette(), viewDistance, fogStartDistance, console.getColorMode());
         //testMaze(&map);  //test用
 
         //プレイヤー情報の初期化
@@ -89,10 +132,15 @@ public:
         
         currentState = GAME_STATE_START_ANIM;
         animationFrame = 0;
+        prepareTransition();
 
         //シェル
         shellLog.clear();
 
+        const char* recordPath = getenv("MAZE_RECORD");
+        if (recordPath && recorder.open(recordPath)) presenter.setRecorder(&recorder);
+        presenter.start(&console);
+
     }
     void mainLoop() {
         // --- 共通処理 ---
@@ -104,11 +152,9 @@ public:
         // --- 現在のシーンに応じた処理 ---
         switch (currentState) {
             case GAME_STATE_START_ANIM: {
-                ScreenBuffer firstGameScreen;
-                firstGameScreen.reallocate(console.getGameScreenBuffer().width, console.getGameScreenBuffer().height);
-                render::setBuffer(&player, &map, &firstGameScreen, portalPos, portalNormal);
-            
-                render::transAnimation(&console.getGameScreenBuffer(), &console.getOriginalScreen(), &firstGameScreen, animationFrame);
+                if (transitionNeedsResize()) prepareTransition();
+                render::transAnimation(&console.getGameScreenBuffer(), &console.getOriginalScreen(), &transitionScreen,
+                    &dissolveMask, animationFrame);
                 animationFrame += animationSpeed;
                 if (animationFrame >= 1.0) {
                     currentState = GAME_STATE_PLAYING; // 次のシーンへ
@@ -124,21 +170,36 @@ public:
                 //プレイヤー操作
                 player.handleInput(&input, deltaTime, &map);
                 //マップとオブジェクト描画
-                render::setBuffer(&player, &map, &console.getGameScreenBuffer(), portalPos, portalNormal);
+                render::setBuffer(&renderContext, &player, &map, &console.getGameScreenBuffer(), portalPos, portalNormal, portalVisible(), &portalTarget);
+
+                if(showMinimap){
+                    minimap.draw(&console.getGameScreenBuffer(), &map, &explored, player.getPos(), player.getDir().x, portalPos);
+                }
 
                 //ゴールポータル接触判定
                 vec::vec3 relativeCoord = portalPos-player.getPos();
                 if(relativeCoord.length()<0.3){
                     currentState = GAME_STATE_END_ANIM; // 次のシーンへ
                     animationFrame = 0; // アニメーションフレームをリセット
+                    prepareTransition();
                     break;
                 }
 
+                //描画方式の切り替え
+                if (input.isPressed[static_cast<int>(GameAction::ToggleRenderer)]){
+                    renderContext.mode = (renderContext.mode == render::RenderMode::Raycast)
+                        ? render::RenderMode::Segment : render::RenderMode::Raycast;
+                }
+
+                if (input.isPressed[static_cast<int>(GameAction::ToggleMinimap)]){
+                    showMinimap = !showMinimap;
+                }
+
                 //シェル操作へ移行
                 if (input.isPressed[static_cast<int>(GameAction::Interact)]){
                     currentState = GAME_STATE_SHELL;
-                    shellTextEditer.update();
-                    shellTextEditer.reset();
+                    shellEditor.discardInput();
+                    shellEditor.reset();
                 }
                 
                 //強制終了判定
@@ -148,30 +209,30 @@ public:
             }
 
             case GAME_STATE_SHELL:{
-                render::setBuffer(&player, &map, &console.getGameScreenBuffer(), portalPos, portalNormal);
+                render::setBuffer(&renderContext, &player, &map, &console.getGameScreenBuffer(), portalPos, portalNormal, portalVisible(), &portalTarget);
                 
                 //コマンド描画
                 {                    
-                    shellTextEditer.update();
-                    if(shellTextEditer.enterPressed){
-                        if (shellTextEditer.currentCommand=="q"){
+                    shellEditor.update();
+                    if(shellEditor.enterPressed){
+                        if (shellEditor.currentCommand=="q"){
                             currentState = GAME_STATE_PLAYING;
-                            shellTextEditer.reset();
+                            shellEditor.reset();
                             break;
                         }
-                        shellLog = sgame.update(shellTextEditer.currentCommand);
-                        shellTextEditer.reset();
+                        shellLog = sgame.update(shellEditor.currentCommand);
+                        shellEditor.reset();
                     }
                     std::string prompt;
                     int cursorPos;
                     if (sgame.currentState == ShellState::PROMPT) {
                         prompt = sgame.getCurrentDirectory()->name + "> ";
-                        cursorPos = prompt.size() + shellTextEditer.cursorPos;
-                        prompt += shellTextEditer.currentCommand + " ";
+                        cursorPos = prompt.size() + shellEditor.cursorPos;
+                        prompt += shellEditor.currentCommand + " ";
                     } else if (sgame.currentState == ShellState::WAITING_PASSWORD) {
                         prompt = "[sudo] password: ";
-                        cursorPos = prompt.size() + shellTextEditer.cursorPos;
-                        prompt += std::string(shellTextEditer.currentCommand.length(), '*');
+                        cursorPos = prompt.size() + shellEditor.cursorPos;
+                        prompt += std::string(shellEditor.currentCommand.length(), '*');
                     }
                     col::CHAR_INF textCol(L' ', { col::WHITE, false }, { col::BLACK, false });
                     col::CHAR_INF cursolCol(L' ', { col::WHITE, false }, { col::BLACK, false });
@@ -217,12 +278,9 @@ public:
             }
 
             case GAME_STATE_END_ANIM: {
-                ScreenBuffer lastGameScreen;
-                lastGameScreen.reallocate(console.getGameScreenBuffer().width, console.getGameScreenBuffer().height);
-                render::setBuffer(&player, &map, &lastGameScreen, 
-                    portalPos, portalNormal);
-            
-                render::transAnimation(&console.getGameScreenBuffer(), &lastGameScreen, &console.getOriginalScreen(), animationFrame);
+                if (transitionNeedsResize()) prepareTransition();
+                render::transAnimation(&console.getGameScreenBuffer(), &transitionScreen, &console.getOriginalScreen(),
+                    &dissolveMask, animationFrame);
                 animationFrame += animationSpeed;
                 if (animationFrame >= 1.0) {
                     currentState = GAME_STATE_EXIT; // 終了へ
@@ -236,11 +294,13 @@ public:
         }
 
         // --- 共通の描画と時間更新 ---
-        console.draw(console.getGameScreenBuffer());
+        presenter.submit(console.getGameScreenBuffer());
         lastTime = currentTime;
     }
 
     ~Game(){
+        presenter.stop();//書き出し途中のフレームを待ってから
+        recorder.close();
         console.restore();//代替バッファから元のバッファへ切り替え
 
         printf("GAME CLEAR\n");
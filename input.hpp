@@ -1,8 +1,8 @@
 #pragma once
 #include <stdlib.h>
-#include <windows.h>
+#include <stdint.h>
 #include <array>
-#include <string>
+#include <atomic>
 
 // enumはenum classにすると、より型安全になる
 enum class GameAction {
@@ -13,6 +13,8 @@ enum class GameAction {
     Jump,
     Interact,
     QuitGame,
+    ToggleRenderer, // 描画方式の切り替え(見比べ用)
+    ToggleMinimap,  // ミニマップの表示切り替え
     // アクションの総数を保持するマーカー
     Count
 };
@@ -24,6 +26,66 @@ struct InputState {
     long deltaMouseY = 0;
 };
 
+// 端末から読んだ入力1つ分(キー1回かマウスの報告1回)
+struct InputEvent {
+    enum class Type : unsigned char { Char, Enter, Backspace, Left, Right, Up, Down, Escape, Mouse };
+    Type type = Type::Char;
+    bool release = false;     // キーを離した(端末が知らせてくれるときだけ来る)
+    char ch = 0;              // Charの文字(ASCII)
+    unsigned char button = 0; // Mouseのボタン(SGR 1006の値．32が立っていれば移動だけ)
+    short x = 0, y = 0;       // Mouseの位置(セル，0始まり)
+};
+
+// 決まった数だけ入るInputEventの輪．入れる側と取り出す側が1つずつなら別のスレッドでもよい(ロックなし)
+// 最初に確保したきりなので，キーを連打しても貼り付けてもヒープを使わない
+class InputEventRing {
+public:
+    static const size_t CAPACITY = 1024; // 2のべき．貼り付け1回分くらいは溜められる
+
+    // いっぱいなら入れずにfalse(読まれていないイベントは上書きしない)
+    bool push(const InputEvent& event){
+        size_t tail = writePos.load(std::memory_order_relaxed);
+        if (tail - readPos.load(std::memory_order_acquire) == CAPACITY) {
+            droppedEvents.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slots[tail & (CAPACITY - 1)] = event;
+        writePos.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 一番古いイベントを取り出す．空ならfalse
+    bool pop(InputEvent& event){
+        size_t head = readPos.load(std::memory_order_relaxed);
+        if (head == writePos.load(std::memory_order_acquire)) return false;
+        event = slots[head & (CAPACITY - 1)];
+        readPos.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return readPos.load(std::memory_order_acquire) == writePos.load(std::memory_order_acquire);
+    }
+
+    // いっぱいで捨てたイベントの数
+    uint64_t getDroppedEvents() const { return droppedEvents.load(std::memory_order_relaxed); }
+
+private:
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+    std::array<InputEvent, CAPACITY> slots;
+    std::atomic<size_t> writePos{0}; // 入れる側だけが進める
+    std::atomic<size_t> readPos{0};  // 取り出す側だけが進める
+    std::atomic<uint64_t> droppedEvents{0};
+};
+
+// キーボードとマウスの読み取りは環境ごとに分ける
+// InputBackend::get() が InputManager と TextInputManager の共有する1つを返す
+#ifdef _WIN32
+#include "inputWin32.hpp"
+#else
+#include "inputPosix.hpp"
+#endif
+
 class InputManager {
 public:
     InputManager();
@@ -31,38 +93,22 @@ public:
     void update();
     void reset();
     const InputState& getState() const { return currentState; }
-    
+
     static void waitKeyUp(GameAction action);
 
 private:
     InputState currentState;
     std::array<bool, static_cast<size_t>(GameAction::Count)> previousDownStates;
-    POINT previousMousePos;
-
-    // キーマップもクラスの静的定数メンバとしてカプセル化
-    static const std::array<int, static_cast<size_t>(GameAction::Count)> keyMap;
 };
 
 
 
-// シェル入力の結果を格納する構造体
-struct TextInputResult {
-    std::string typedChars;
-    bool backspacePressed = false;
-    bool enterPressed = false;
-    bool arrowLeftPressed = false;
-    bool arrowRightPressed = false;
-    bool arrowUpPressed = false;   // (コマンド履歴用)
-    bool arrowDownPressed = false; // (コマンド履歴用)
-};
-
 // シェル（テキスト入力）専用の新しい入力クラス
 // InputManager とは「同居」する
 class TextInputManager {
 public:
     TextInputManager();
-    // 毎フレーム呼び出され、入力イベントを処理する
-    TextInputResult update();
-private:
-    HANDLE hConsoleInput;
-};
\ No newline at end of file
+    // 前回から届いたキーを古い順に1つずつ取り出す．なくなったらfalse
+    // 毎フレーム空になるまで呼び出す(Char，Enter，Backspace，矢印，Escapeの押されたときだけが来る)
+    bool next(InputEvent& event);
+};
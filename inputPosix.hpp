@@ -0,0 +1,335 @@
+#pragma once
+// POSIX端末(標準入力)による入力の実装．input.hppから(GameActionなどの定義のあとで)読み込む
+// 端末をrawモードにするのはConsole(consolePosix.hpp)で，ここは届いたバイトを読んで分けるだけ
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <ctype.h>
+#include <string.h>
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+// 端末から届くバイト列をInputEventに分ける．readの切れ目とシーケンスの切れ目は合わないので
+// 途中までのシーケンスは次のfeedへ持ち越す
+//  ・ふつうの文字，Enter(CR/LF)，Backspace(DEL/BS)，ESC [ A~D と ESC O A~D の矢印
+//  ・SGR 1006のマウス ESC [ < ボタン ; x ; y M/m
+//  ・kittyのキーボード拡張 ESC [ コード ; 修飾:種類 ; 文字 u (離したことも分かる)
+class TerminalDecoder {
+public:
+    template <typename Sink>
+    void feed(const unsigned char* data, size_t size, Sink& sink){
+        for (size_t i = 0; i < size; i++) feedByte(data[i], sink);
+    }
+
+    // ESCだけが来て続きがまだない．少し待っても来なければflushEscapeでEscキーにする
+    bool hasPendingEscape() const { return state == State::Escape; }
+
+    template <typename Sink>
+    void flushEscape(Sink& sink){
+        if (state != State::Escape) return;
+        state = State::Ground;
+        emitKey(InputEvent::Type::Escape, 0, false, sink);
+    }
+
+private:
+    enum class State : unsigned char { Ground, Escape, Csi, Ss3 };
+    static const int MAX_PARAMS = 32; // これより長いCSIは読み捨てる
+
+    template <typename Sink>
+    void feedByte(unsigned char b, Sink& sink){
+        switch (state) {
+        case State::Ground:
+            feedGround(b, sink);
+            break;
+        case State::Escape:
+            if (b == '[') {
+                state = State::Csi;
+                length = 0;
+                overflow = false;
+            } else if (b == 'O') {
+                state = State::Ss3;
+            } else if (b == 0x1b) {
+                emitKey(InputEvent::Type::Escape, 0, false, sink); // ESCが2回続いたら1回目はEscキー
+            } else {
+                state = State::Ground;
+                feedGround(b, sink); // Alt+キーはAltを無視する
+            }
+            break;
+        case State::Csi:
+            if (b >= 0x20 && b <= 0x3F) { // 引数と中間バイト
+                if (length < MAX_PARAMS) params[length++] = (char)b;
+                else overflow = true;
+            } else {
+                state = State::Ground;
+                if (b >= 0x40 && b <= 0x7E && !overflow) dispatchCsi((char)b, sink);
+            }
+            break;
+        case State::Ss3:
+            state = State::Ground;
+            emitArrow((char)b, false, sink);
+            break;
+        }
+    }
+
+    template <typename Sink>
+    void feedGround(unsigned char b, Sink& sink){
+        if (b == 0x1b) state = State::Escape;
+        else if (b == '\r' || b == '\n') emitKey(InputEvent::Type::Enter, 0, false, sink);
+        else if (b == 0x7F || b == 0x08) emitKey(InputEvent::Type::Backspace, 0, false, sink);
+        else if (b >= 0x20 && b < 0x7F) emitKey(InputEvent::Type::Char, (char)b, false, sink);
+        // それ以外の制御文字とASCII以外(UTF-8)は使わないので捨てる
+    }
+
+    template <typename Sink>
+    void dispatchCsi(char final, Sink& sink){
+        if (length > 0 && params[0] == '<') {
+            if (final != 'M' && final != 'm') return;
+            InputEvent e;
+            e.type = InputEvent::Type::Mouse;
+            e.button = (unsigned char)field(1, 0, 0, 0);
+            e.x = (short)(field(1, 1, 0, 1) - 1);
+            e.y = (short)(field(1, 2, 0, 1) - 1);
+            e.release = final == 'm';
+            sink(e);
+            return;
+        }
+        if (length > 0 && (params[0] < '0' || params[0] > ';')) return; // ?や>で始まるのは返答なので無視
+        bool release = field(0, 1, 1, 1) == 3; // 種類 1:押した 2:繰り返し 3:離した
+        if (final != 'u') {
+            emitArrow(final, release, sink);
+            return;
+        }
+        int code = field(0, 0, 0, 0);
+        int modifiers = field(0, 1, 0, 1) - 1; // 1:Shift 2:Alt 4:Ctrl
+        int text = field(0, 2, 0, 0);
+        if (code == 27) emitKey(InputEvent::Type::Escape, 0, release, sink);
+        else if (code == 13) emitKey(InputEvent::Type::Enter, 0, release, sink);
+        else if (code == 127 || code == 8) emitKey(InputEvent::Type::Backspace, 0, release, sink);
+        else if (code >= 0x20 && code < 0x7F) {
+            if (modifiers & 4) {
+                // 拡張中はCtrl+Cもシーケンスで届くので，端末の代わりにSIGINTを送る(端末を戻すのはConsoleのハンドラ)
+                if (tolower(code) == 'c' && !release) raise(SIGINT);
+                return;
+            }
+            char c = (text >= 0x20 && text < 0x7F) ? (char)text : (char)code;
+            if (text == 0 && (modifiers & 1)) c = (char)toupper(c);
+            emitKey(InputEvent::Type::Char, c, release, sink);
+        }
+    }
+
+    template <typename Sink>
+    void emitArrow(char final, bool release, Sink& sink){
+        if (final == 'A') emitKey(InputEvent::Type::Up, 0, release, sink);
+        else if (final == 'B') emitKey(InputEvent::Type::Down, 0, release, sink);
+        else if (final == 'C') emitKey(InputEvent::Type::Right, 0, release, sink);
+        else if (final == 'D') emitKey(InputEvent::Type::Left, 0, release, sink);
+    }
+
+    template <typename Sink>
+    static void emitKey(InputEvent::Type type, char ch, bool release, Sink& sink){
+        InputEvent e;
+        e.type = type;
+        e.ch = ch;
+        e.release = release;
+        sink(e);
+    }
+
+    // 引数のうちfirstバイト目から数えてparam番目(;区切り)のsub番目(:区切り)の数．なければfallback
+    int field(int first, int param, int sub, int fallback) const {
+        int p = 0, s = 0, value = -1;
+        for (int i = first; i < length; i++) {
+            char c = params[i];
+            if (c == ';') {
+                if (p == param) break;
+                p++;
+                s = 0;
+            } else if (c == ':') {
+                s++;
+            } else if (c >= '0' && c <= '9' && p == param && s == sub) {
+                value = (value < 0 ? 0 : value) * 10 + (c - '0');
+                if (value > 0xFFFF) value = 0xFFFF;
+            }
+        }
+        return value < 0 ? fallback : value;
+    }
+
+    State state = State::Ground;
+    char params[MAX_PARAMS];
+    int length = 0;
+    bool overflow = false;
+};
+
+// 標準入力は別スレッドがpollで待って読み，ゲーム側は読んだ結果を取り出すだけにする
+// (入力がなければどちらのスレッドもシステムコールを呼ばない)
+class InputBackend {
+public:
+    // 端末はキーを押し続けても同じキーを繰り返し送るだけで，離したことを知らせない
+    // そこで最後に届いてからこの時間が過ぎたら離したとみなす(離したことが分かる端末では使わない)
+    static constexpr double FIRST_HOLD_SECONDS = 0.5;  // 1回目から繰り返しが始まるまで(端末の既定はおよそ0.25~0.5秒)
+    static constexpr double REPEAT_HOLD_SECONDS = 0.1; // 繰り返しの間隔(およそ30ms)に余裕を持たせたもの
+    static const int ESCAPE_TIMEOUT_MS = 30;           // ESCのあとこれだけ続きが来なければEscキー
+    static const int MOUSE_CELL_X = 8;                 // マウスの1セルの移動をWin32のピクセル数くらいに合わせる
+    static const int MOUSE_CELL_Y = 16;
+
+    static InputBackend& get(){
+        static InputBackend backend;
+        return backend;
+    }
+
+    bool isKeyDown(GameAction action){
+        std::lock_guard<std::mutex> lock(mutex);
+        KeyHold& key = keys[static_cast<size_t>(action)];
+        bool held = key.unseen || isHeld(key, Clock::now());
+        key.unseen = false;
+        return held;
+    }
+
+    // 前回呼んでからのマウスの移動量(セル数をピクセルくらいに広げたもの)
+    void takeMouseDelta(long& dx, long& dy){
+        std::lock_guard<std::mutex> lock(mutex);
+        dx = mouseDx;
+        dy = mouseDy;
+        mouseDx = 0;
+        mouseDy = 0;
+    }
+
+    // 前回から届いたキーを1つ取り出す(読み取りスレッドが入れた輪から取るだけなのでロックしない)
+    bool nextTextEvent(InputEvent& event){
+        return text.pop(event);
+    }
+
+    void waitKeyUp(GameAction action){
+        while (isKeyDown(action)) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct KeyHold {
+        Clock::time_point last; // 最後に届いた時刻(繰り返しを含む)
+        bool down = false;
+        bool repeating = false; // 2回目以降が届いた(間隔が短くなる)
+        bool unseen = false;    // 押されてからまだisKeyDownで読まれていない(1フレームより短く押されても取りこぼさない)
+    };
+
+    // マウスの報告やkittyの拡張はConsoleが端末に頼む(止められたときに戻すのもConsole)
+    InputBackend(){
+        if (pipe(wakePipe) != 0) {
+            wakePipe[0] = wakePipe[1] = -1;
+            return;
+        }
+        reader = std::thread([this](){ loop(); });
+    }
+    ~InputBackend(){
+        if (reader.joinable()) {
+            char c = 0;
+            while (write(wakePipe[1], &c, 1) < 0 && errno == EINTR) {}
+            reader.join();
+        }
+        if (wakePipe[0] >= 0) {
+            close(wakePipe[0]);
+            close(wakePipe[1]);
+        }
+    }
+    InputBackend(const InputBackend&) = delete;
+    InputBackend& operator=(const InputBackend&) = delete;
+
+    void loop(){
+        unsigned char bytes[256];
+        while (true) {
+            pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {wakePipe[0], POLLIN, 0}};
+            int n = poll(fds, 2, decoder.hasPendingEscape() ? ESCAPE_TIMEOUT_MS : -1);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            if (fds[1].revents) return; // 終了の合図
+            Clock::time_point now = Clock::now();
+            auto sink = [this, now](const InputEvent& e){ onEvent(e, now); };
+            if (n == 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                decoder.flushEscape(sink);
+                continue;
+            }
+            if (!(fds[0].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            ssize_t size = read(STDIN_FILENO, bytes, sizeof(bytes));
+            if (size < 0) {
+                if (errno == EINTR || errno == EAGAIN) continue;
+                return;
+            }
+            if (size == 0) return; // 読めると言われて0なら終わり(端末が閉じた)
+            std::lock_guard<std::mutex> lock(mutex);
+            decoder.feed(bytes, (size_t)size, sink);
+        }
+    }
+
+    // mutexを取った状態で呼ぶ
+    void onEvent(const InputEvent& e, Clock::time_point now){
+        if (e.type == InputEvent::Type::Mouse) {
+            if (hasMousePos) {
+                mouseDx += (e.x - mouseX) * MOUSE_CELL_X;
+                mouseDy += (e.y - mouseY) * MOUSE_CELL_Y;
+            }
+            mouseX = e.x;
+            mouseY = e.y;
+            hasMousePos = true;
+            return;
+        }
+        int action = actionOf(e);
+        if (e.release) {
+            exactRelease = true; // 以後は時間切れを使わない
+            if (action >= 0) {
+                keys[action].down = false;
+                keys[action].repeating = false;
+            }
+            return;
+        }
+        if (action >= 0) {
+            KeyHold& key = keys[action];
+            key.repeating = isHeld(key, now);
+            key.down = true;
+            key.unseen = true;
+            key.last = now;
+        }
+        text.push(e); // シェル用．いっぱいなら捨てる
+    }
+
+    bool isHeld(const KeyHold& key, Clock::time_point now) const {
+        if (!key.down) return false;
+        if (exactRelease) return true;
+        double limit = key.repeating ? REPEAT_HOLD_SECONDS : FIRST_HOLD_SECONDS;
+        return std::chrono::duration<double>(now - key.last).count() < limit;
+    }
+
+    // Win32のキーマップと同じ割り当て(文字は大文字小文字を区別しない)
+    static int actionOf(const InputEvent& e){
+        if (e.type == InputEvent::Type::Escape) return static_cast<int>(GameAction::QuitGame);
+        if (e.type != InputEvent::Type::Char) return -1;
+        switch (tolower(e.ch)) {
+        case 'w': return static_cast<int>(GameAction::MoveForward);
+        case 's': return static_cast<int>(GameAction::MoveBack);
+        case 'a': return static_cast<int>(GameAction::MoveLeft);
+        case 'd': return static_cast<int>(GameAction::MoveRight);
+        case ' ': return static_cast<int>(GameAction::Jump);
+        case 'e': return static_cast<int>(GameAction::Interact);
+        case 'r': return static_cast<int>(GameAction::ToggleRenderer);
+        case 'm': return static_cast<int>(GameAction::ToggleMinimap);
+        default: return -1;
+        }
+    }
+
+    std::mutex mutex; // 読み取りスレッドとゲーム側の間で以下を守る
+    TerminalDecoder decoder;
+    std::array<KeyHold, static_cast<size_t>(GameAction::Count)> keys;
+    bool exactRelease = false; // 端末が離したことを知らせてくる
+    long mouseDx = 0, mouseDy = 0;
+    int mouseX = 0, mouseY = 0;
+    bool hasMousePos = false;
+    InputEventRing text; // 押されたキー(読み取りスレッドが入れ，シェルが取り出す)
+
+    int wakePipe[2] = {-1, -1}; // 書くと読み取りスレッドが終わる
+    std::thread reader;
+};
@@ -0,0 +1,128 @@
+#pragma once
+// Win32 APIによる入力の実装．input.hppから(GameActionなどの定義のあとで)読み込む
+#include <windows.h>
+#include <array>
+
+class InputBackend {
+public:
+    static InputBackend& get(){
+        static InputBackend backend;
+        return backend;
+    }
+
+    // GetAsyncKeyStateの最上位ビットが1なら押されている
+    bool isKeyDown(GameAction action){
+        int vKey = keyMap()[static_cast<size_t>(action)];
+        if (vKey == 0) return false; // 未割り当てのアクション
+        return (GetAsyncKeyState(vKey) & 0x8000) != 0;
+    }
+
+    // 前回呼んでからのマウスの移動量(画面のピクセル)
+    void takeMouseDelta(long& dx, long& dy){
+        POINT currentMousePos;
+        GetCursorPos(&currentMousePos);
+        dx = currentMousePos.x - previousMousePos.x;
+        dy = currentMousePos.y - previousMousePos.y;
+        previousMousePos = currentMousePos;
+    }
+
+    // 前回から届いたキーを1つ取り出す．輪が空のときだけコンソールの入力キューから読み足す
+    bool nextTextEvent(InputEvent& event){
+        if (text.empty()) readConsoleEvents();
+        return text.pop(event);
+    }
+
+    void waitKeyUp(GameAction action){
+        while (isKeyDown(action)) {}
+    }
+
+    // 入力キューを読み，前回呼んでから大きさの変更イベント(WINDOW_BUFFER_SIZE_EVENT)があればtrue
+    // Consoleが毎フレーム呼ぶので，シェルを開いていない間もキューは溜まらない
+    bool takeResizeEvent(){
+        readConsoleEvents();
+        bool resized = resizePending;
+        resizePending = false;
+        return resized;
+    }
+
+private:
+    InputBackend(){
+        GetCursorPos(&previousMousePos);
+        hConsoleInput = GetStdHandle(STD_INPUT_HANDLE);
+    }
+    InputBackend(const InputBackend&) = delete;
+    InputBackend& operator=(const InputBackend&) = delete;
+
+    // 入力キューが空になるまでrecordsの数ずつ読み，キーが押されたイベントをtextへ入れる
+    // 大きさの変更はresizePendingに残す．シェルを開いていない間のキーは誰も取り出さないので，
+    // textがいっぱいなら捨てる(シェルを開くときに読み捨てる分)
+    void readConsoleEvents(){
+        while (true) {
+            DWORD numEvents = 0;
+            GetNumberOfConsoleInputEvents(hConsoleInput, &numEvents);
+            if (numEvents == 0) return; // 入力がなければ即終了
+
+            DWORD numEventsRead = 0;
+            ReadConsoleInput(hConsoleInput, records.data(), numEvents < records.size() ? numEvents : (DWORD)records.size(), &numEventsRead);
+            if (numEventsRead == 0) return;
+            for (DWORD i = 0; i < numEventsRead; ++i) handleRecord(records[i]);
+        }
+    }
+
+    void handleRecord(const INPUT_RECORD& record){
+        if (record.EventType == WINDOW_BUFFER_SIZE_EVENT) {
+            resizePending = true;
+            return;
+        }
+        if (record.EventType != KEY_EVENT || !record.Event.KeyEvent.bKeyDown) return;
+
+        // キーが押されたイベントのみ処理
+        WORD keyCode = record.Event.KeyEvent.wVirtualKeyCode;
+        WCHAR unicodeChar = record.Event.KeyEvent.uChar.UnicodeChar;
+        InputEvent e;
+        if (keyCode == VK_RETURN) {
+            e.type = InputEvent::Type::Enter;
+        } else if (keyCode == VK_BACK) {
+            e.type = InputEvent::Type::Backspace;
+        } else if (keyCode == VK_ESCAPE) {
+            e.type = InputEvent::Type::Escape;
+        } else if (keyCode == VK_LEFT) {
+            e.type = InputEvent::Type::Left;
+        } else if (keyCode == VK_RIGHT) {
+            e.type = InputEvent::Type::Right;
+        } else if (keyCode == VK_UP) {
+            e.type = InputEvent::Type::Up;
+        } else if (keyCode == VK_DOWN) {
+            e.type = InputEvent::Type::Down;
+        } else if (unicodeChar >= 32) {
+            e.type = InputEvent::Type::Char;
+            e.ch = static_cast<char>(unicodeChar);
+        } else {
+            return;
+        }
+        text.push(e);
+    }
+
+    static const std::array<int, static_cast<size_t>(GameAction::Count)>& keyMap(){
+        static const std::array<int, static_cast<size_t>(GameAction::Count)> map = {
+            'W',            //ACTION_MOVE_FORWARD
+            'S',            //ACTION_MOVE_BACK
+            'A',            //ACTION_MOVE_LEFT
+            'D',            //ACTION_MOVE_RIGHT
+            VK_SPACE,       //ACTION_JUMP
+            'E',            //ACTION_INTERACT
+            VK_ESCAPE,      //ACTION_QUIT_GAME// Escapeキー
+            'R',            //ACTION_TOGGLE_RENDERER
+            'M'             //ACTION_TOGGLE_MINIMAP
+        };
+        return map;
+    }
+
+    static const size_t RECORD_CHUNK = 64; // 1回に読む入力レコードの数
+
+    POINT previousMousePos;
+    HANDLE hConsoleInput;
+    std::array<INPUT_RECORD, RECORD_CHUNK> records; // 読み込み用(使い回す)
+    InputEventRing text;                            // シェル用のキー
+    bool resizePending = false;                     // 読んだ中に大きさの変更があった
+};
@@ -0,0 +1,118 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include "maze.hpp"
+
+//迷路を作ったときに焼き込んでおく明るさ(隅の暗さ)
+namespace lighting
+{
+    //床のマスごと，壁の面ごとの明るさ．周りの壁の並びだけで決まるので
+    //描画ではマスと面から表を引くだけで，ピクセルごとの計算は増えない
+    class LightMap{
+    public:
+        static constexpr int LEVELS = 3;//0:暗い ~ LEVELS-1:そのまま
+        static constexpr int FULL = LEVELS - 1;
+
+        //面の番号．法線の向きで -x, +x, -z, +z
+        static int faceIndex(int side, double dirX, double dirZ){
+            return side == 0 ? (dirX >= 0 ? 0 : 1) : (dirZ >= 0 ? 2 : 3);
+        }
+
+        //迷路全体を焼き直す．行をthreadCount個に分けて並列に処理する(0ならCPUの数)
+        void bake(const maze::Maze *map, int threadCount = 0){
+            width = map->getWidth();
+            height = map->getHeight();
+            floorLight.assign(width * height, FULL);
+            faceLight.assign(width * height * 4, FULL);
+            if(threadCount <= 0) threadCount = (int)std::thread::hardware_concurrency();
+            threadCount = std::max(1, std::min(threadCount, height));
+            std::vector<std::thread> workers;
+            for(int t=1; t<threadCount; t++){
+                workers.emplace_back([=](){ bakeRect(map, 0, height * t / threadCount, width, height * (t+1) / threadCount); });
+            }
+            bakeRect(map, 0, 0, width, height / threadCount);
+            for(size_t t=0; t<workers.size(); t++) workers[t].join();
+            revision = map->getRevision();
+            generation = map->getGeneration();
+            appliedRemovals = map->getRemovedWalls().size();
+            built = true;
+        }
+
+        //迷路に追いつかせる．階が変わっていれば焼き直し，壁が壊されただけなら
+        //前回から壊された壁の周りだけを焼く(毎フレーム呼んでよい)
+        void update(const maze::Maze *map, int threadCount = 0){
+            if(isBuiltFor(map)) return;
+            const std::vector<maze::RemovedWall> &removed = map->getRemovedWalls();
+            if(!built || generation != map->getGeneration() || appliedRemovals > removed.size() ||
+                    map->getWidth() != width || map->getHeight() != height){
+                bake(map, threadCount);
+                return;
+            }
+            for(; appliedRemovals < removed.size(); appliedRemovals++){
+                onWallRemoved(map, removed[appliedRemovals].x, removed[appliedRemovals].y);
+            }
+            revision = map->getRevision();
+        }
+
+        bool isBuiltFor(const maze::Maze *map) const {
+            return built && revision == map->getRevision() && width == map->getWidth() && height == map->getHeight();
+        }
+
+        int floorAt(int x, int y) const {
+            if(x < 0 || x >= width || y < 0 || y >= height) return FULL;
+            return floorLight[y * width + x];
+        }
+        int faceAt(int cellX, int cellY, int faceID) const {
+            if(cellX < 0 || cellX >= width || cellY < 0 || cellY >= height) return FULL;
+            return faceLight[(cellY * width + cellX) * 4 + faceID];
+        }
+
+    private:
+        //(x,y)の壁が壊されたあと．床は上下左右，面は隣のマスとその両脇を見るので
+        //影響は2マス以内に収まる
+        void onWallRemoved(const maze::Maze *map, int x, int y){
+            bakeRect(map, std::max(0, x-2), std::max(0, y-2), std::min(width, x+3), std::min(height, y+3));
+        }
+
+        //[x0,x1)×[y0,y1)を焼く．書き込むのはこの範囲だけなのでワーカー同士はぶつからない
+        void bakeRect(const maze::Maze *map, int x0, int y0, int x1, int y1){
+            const int normals[4][2] = {{-1,0},{1,0},{0,-1},{0,1}};
+            for(int y=y0; y<y1; y++){
+                for(int x=x0; x<x1; x++){
+                    int id = y * width + x;
+                    if(map->getNum(x, y) == 0){
+                        //行き止まりほど暗い(通路の両脇の壁までは普通の明るさ)
+                        int walls = 0;
+                        for(int i=0; i<4; i++) walls += map->getNum(x + normals[i][0], y + normals[i][1]) > 0;
+                        floorLight[id] = (uint8_t)std::min(FULL, 4 - walls);
+                        for(int i=0; i<4; i++) faceLight[id*4 + i] = FULL;
+                        continue;
+                    }
+                    floorLight[id] = FULL;
+                    for(int i=0; i<4; i++){
+                        //面の前のマスの両脇が壁なら，その端は入隅になって暗い
+                        int nx = x + normals[i][0], ny = y + normals[i][1];
+                        int corners = 0;
+                        if(map->getNum(nx, ny) == 0){
+                            int tx = normals[i][1], ty = normals[i][0];//面に沿った向き
+                            corners += map->getNum(nx + tx, ny + ty) > 0;
+                            corners += map->getNum(nx - tx, ny - ty) > 0;
+                        }
+                        faceLight[id*4 + i] = (uint8_t)(FULL - std::min(FULL, corners));
+                    }
+                }
+            }
+        }
+
+        std::vector<uint8_t> floorLight;
+        std::vector<uint8_t> faceLight;
+        int width = 0;
+        int height = 0;
+        unsigned int revision = 0;
+        unsigned int generation = 0;
+        size_t appliedRemovals = 0;//getRemovedWallsのうち反映済みの数
+        bool built = false;
+    };
+}
@@ -1,7 +1,8 @@
-#include "Maze.hpp"
+#include "maze.hpp"
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h> // rand, srand
+#include <algorithm>
 
 namespace maze {
 
@@ -14,7 +15,12 @@ struct WallCandidate {
 
 
 void Maze::generate(int cellWidth, int cellHeight) {
-    srand((unsigned int)time(NULL));
+    // 続けて生成した階が同じにならないよう，種は最初の1回だけ設定する
+    static bool seeded = false;
+    if (!seeded) {
+        srand((unsigned int)time(NULL));
+        seeded = true;
+    }
 
     // 最終的なバイナリマップのサイズを計算・設定
     width = cellWidth * 2 + 1;
@@ -28,6 +34,22 @@ void Maze::generate(int cellWidth, int cellHeight) {
 
     // 2. 壁情報をもとに、最終的なバイナリマップを作成する
     convertToBinaryMap(wallData, cellWidth, cellHeight);
+
+    // 3. 描画用に壁の線分をまとめる
+    buildSegments();
+    removedWalls.clear();
+    generation++;
+    revision++;
+}
+
+bool Maze::removeWall(int x, int y) {
+    if (x <= 0 || x >= width - 1 || y <= 0 || y >= height - 1) return false;
+    if (mapData[y * width + x] == 0) return false;
+    mapData[y * width + x] = 0;
+    buildSegments();
+    removedWalls.push_back({x, y});
+    revision++;
+    return true;
 }
 
 // 壁情報を生成するヘルパー関数 (旧internalGenerate)
@@ -109,19 +131,117 @@ void Maze::convertToBinaryMap(const std::vector<int>& wallData, int cellWidth, i
     }
 }
 
+// 壁と通路の境目の面を，同じ向き・同じ壁番号の間だけ一直線につなげる
+void Maze::buildSegments() {
+    segments.clear();
+    for (int axis = 0; axis < 2; axis++) {
+        int lines = (axis == 0) ? width : height;   // 面の座標は0~lines
+        int length = (axis == 0) ? height : width;  // 面に沿った方向のマス数
+        for (int c = 0; c <= lines; c++) {
+            WallSegment current = {axis, c, 0, 0, 0, 0};
+            bool open = false;
+            for (int i = 0; i <= length; i++) {
+                int facing = 0;
+                int objectID = 0;
+                if (i < length) {
+                    // 面の手前側(c-1)と奥側(c)のマス
+                    int before = (axis == 0) ? getNum(c - 1, i) : getNum(i, c - 1);
+                    int after = (axis == 0) ? getNum(c, i) : getNum(i, c);
+                    if (before > 0 && after == 0) { facing = 1; objectID = before; }
+                    else if (before == 0 && after > 0) { facing = -1; objectID = after; }
+                }
+                if (open && (facing != current.facing || objectID != current.objectID)) {
+                    current.to = i;
+                    segments.push_back(current);
+                    open = false;
+                }
+                if (!open && facing != 0) {
+                    current.from = i;
+                    current.facing = facing;
+                    current.objectID = objectID;
+                    open = true;
+                }
+            }
+        }
+    }
+
+    // ブロックごとの索引
+    blockCountX = (width + SEGMENT_BLOCK - 1) / SEGMENT_BLOCK;
+    blockCountY = (height + SEGMENT_BLOCK - 1) / SEGMENT_BLOCK;
+    segmentBlocks.assign(blockCountX * blockCountY, {});
+    for (int i = 0; i < (int)segments.size(); i++) {
+        const WallSegment& seg = segments[i];
+        // 線分が触れるマスの範囲(面の座標が境界にあるときは両側のブロックに入れる)
+        int x0, x1, y0, y1;
+        if (seg.axis == 0) {
+            x0 = seg.coord - 1; x1 = seg.coord;
+            y0 = seg.from;      y1 = seg.to - 1;
+        } else {
+            x0 = seg.from;      x1 = seg.to - 1;
+            y0 = seg.coord - 1; y1 = seg.coord;
+        }
+        int bx0 = std::max(x0, 0) / SEGMENT_BLOCK, bx1 = std::min(x1, width - 1) / SEGMENT_BLOCK;
+        int by0 = std::max(y0, 0) / SEGMENT_BLOCK, by1 = std::min(y1, height - 1) / SEGMENT_BLOCK;
+        for (int by = by0; by <= by1; by++) {
+            for (int bx = bx0; bx <= bx1; bx++) {
+                segmentBlocks[by * blockCountX + bx].push_back(i);
+            }
+        }
+    }
+}
+
+const std::vector<int>& Maze::getSegmentsInBlock(int bx, int by) const {
+    static const std::vector<int> empty;
+    if (bx < 0 || bx >= blockCountX || by < 0 || by >= blockCountY) return empty;
+    return segmentBlocks[by * blockCountX + bx];
+}
+
 int Maze::getNum(int x, int y) const {
     if (x < 0 || x >= width || y < 0 || y >= height) return 1; // 範囲外は壁扱い
     return mapData[y * width + x];
 }
 
 void Maze::print() const {
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            if(x == 1 && y == 1) printf("S");
-            else if(x == width - 2 && y == height - 2) printf("G");
-            else printf("%s", getNum(x, y) == 0 ? " " : "■");
+    printBraille(stdout, 0, 0, width, height);
+}
+
+void Maze::printBraille(FILE* out, int x0, int y0, int viewWidth, int viewHeight) const {
+    // 範囲を迷路の中に切り詰める
+    int x1 = std::min(width, x0 + viewWidth);
+    int y1 = std::min(height, y0 + viewHeight);
+    x0 = std::max(0, x0);
+    y0 = std::max(0, y0);
+    if (x1 <= x0 || y1 <= y0) return;
+
+    // 点字の点の並び (U+2800からのオフセット)
+    //   左列: 上から0x01,0x02,0x04,0x40  右列: 0x08,0x10,0x20,0x80
+    const int glyphs = (x1 - x0 + 1) / 2;
+    std::vector<char> line(glyphs * 3 + 1); // UTF-8で1文字3バイト + 改行
+    std::vector<int> emptyRow(x1 - x0 + 1, 0); // 下端や右端のはみ出し用
+
+    for (int gy = y0; gy < y1; gy += 4) {
+        // 4行分の先頭(範囲外の行は空の行)．x0を引いて0から数えられるようにしておく
+        const int* rows[4];
+        for (int r = 0; r < 4; r++) {
+            rows[r] = (gy + r < y1) ? &mapData[(gy + r) * width + x0] : emptyRow.data();
+        }
+        const int fullPairs = (x1 - x0) / 2;
+        char* p = line.data();
+        for (int g = 0; g < glyphs; g++) {
+            int a = g * 2;
+            int b = (g < fullPairs) ? a + 1 : -1; // 奇数幅の右端は右列なし
+            unsigned int bits =
+                (rows[0][a] > 0) | (rows[1][a] > 0) << 1 | (rows[2][a] > 0) << 2 | (rows[3][a] > 0) << 6;
+            if (b >= 0) {
+                bits |= (rows[0][b] > 0) << 3 | (rows[1][b] > 0) << 4 | (rows[2][b] > 0) << 5 | (rows[3][b] > 0) << 7;
+            }
+            p[0] = (char)0xE2;
+            p[1] = (char)(0xA0 | (bits >> 6));
+            p[2] = (char)(0x80 | (bits & 0x3F));
+            p += 3;
         }
-        printf("\n");
+        *p++ = '\n';
+        fwrite(line.data(), 1, p - line.data(), out);
     }
 }
 
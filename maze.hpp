@@ -1,9 +1,24 @@
 #pragma once
 #include <vector>
+#include <stdio.h>
 
 // Mazeクラスをmaze名前空間に入れる
 namespace maze {
 
+// 壁と通路の境目を一直線にまとめたもの(面の向きと壁番号が同じ間だけ伸ばす)
+struct WallSegment {
+    int axis;      // 0: x=coordの面(範囲はz)  1: z=coordの面(範囲はx)
+    int coord;
+    int from, to;  // 面が伸びる範囲 [from, to)
+    int facing;    // 面の法線の向き(+1/-1)．通路側を向く
+    int objectID;  // 壁番号
+};
+
+// removeWallで通路にしたマス
+struct RemovedWall {
+    int x, y;
+};
+
 class Maze {
 public:
     // コンストラクタ
@@ -15,21 +30,52 @@ public:
     // 指定座標のデータを取得する (constを追加)
     int getNum(int x, int y) const;
     
-    // デバッグ用に迷路を描画する (constを追加)
+    // デバッグ用に迷路全体を描画する (printBrailleで全体を標準出力へ)
     void print() const;
+    // 点字1文字に横2×縦4マスを詰めて(x0,y0)からviewWidth×viewHeightの範囲を書き出す
+    // 行ごとに1回だけfwriteするので，大きな迷路でもすぐに出力できる
+    void printBraille(FILE* out, int x0, int y0, int viewWidth, int viewHeight) const;
     
     // マップの幅と高さを取得するゲッター
     int getWidth() const { return width; }
     int getHeight() const { return height; }
+    // 範囲チェックなしで読む用(width*height，行ごと)
+    const int* getMapData() const { return mapData.data(); }
+
+    // 内側の壁(x,y)を通路にする．外周や通路なら何もせずfalse
+    bool removeWall(int x, int y);
+    // 迷路を作り直したり壁を壊したりするたびに増える．キャッシュの作り直し判定に使う
+    unsigned int getRevision() const { return revision; }
+    // generateのたびだけ増える．これが同じ間の変化はgetRemovedWallsに残っている
+    unsigned int getGeneration() const { return generation; }
+    // generateしてから壊した壁(壊した順)．キャッシュは前回見た続きだけを直せばよい
+    const std::vector<RemovedWall>& getRemovedWalls() const { return removedWalls; }
+
+    // 壁の線分と，それをSEGMENT_BLOCKマス四方のブロックごとに分けた索引
+    static const int SEGMENT_BLOCK = 8;
+    const std::vector<WallSegment>& getSegments() const { return segments; }
+    int getBlockCountX() const { return blockCountX; }
+    int getBlockCountY() const { return blockCountY; }
+    // ブロック(bx,by)にかかる線分の番号(範囲外は空)
+    const std::vector<int>& getSegmentsInBlock(int bx, int by) const;
 
 private:
     // ヘルパー関数 (外部から隠蔽)
     void generateWallData(std::vector<int>& wallData, int cellWidth, int cellHeight);
     void convertToBinaryMap(const std::vector<int>& wallData, int cellWidth, int cellHeight);
+    void buildSegments();
 
     int width = 0;
     int height = 0;
     std::vector<int> mapData;
+
+    std::vector<WallSegment> segments;
+    std::vector<std::vector<int>> segmentBlocks;
+    int blockCountX = 0;
+    int blockCountY = 0;
+    unsigned int revision = 0;
+    unsigned int generation = 0;
+    std::vector<RemovedWall> removedWalls;
 };
 
 } // namespace maze
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+#include <math.h>
+#include <algorithm>
+#include "vec.hpp"
+#include "console.hpp"
+#include "maze.hpp"
+#include "explored.hpp"
+
+//画面の隅に出す見下ろしの地図
+namespace minimap
+{
+    //探索済みのマスだけを描いた地図．表示範囲より広い範囲を一度描いてScreenBufferに取っておき
+    //迷路か探索済みのマスが変わったときと，表示範囲がはみ出したときだけ描き直す
+    //毎フレームの手間は切り出しのコピーと印の書き込みだけで，迷路の大きさによらない
+    class Minimap{
+    public:
+        static const int VIEW_CELLS_X = 16;//表示するマスの数(1マスは横2文字)
+        static const int VIEW_CELLS_Y = 10;
+        static const int MARGIN = 8;//取っておく範囲は表示範囲の外側にこれだけ広い
+        static const int TILE_CELLS_X = VIEW_CELLS_X + MARGIN*2;
+        static const int TILE_CELLS_Y = VIEW_CELLS_Y + MARGIN*2;
+
+        //sbの右上に重ねる．yawはプレイヤーの向き(Player::getDir().x)
+        void draw(ScreenBuffer *sb, const maze::Maze *map, const explore::ExploredMap *explored,
+                vec::vec3 playerPos, double yaw, vec::vec3 portalPos){
+            const int screenX0 = sb->width - VIEW_CELLS_X*2;
+            if(screenX0 < 0 || sb->height < VIEW_CELLS_Y) return;//画面が小さすぎる
+
+            const int viewX0 = (int)floor(playerPos.x) - VIEW_CELLS_X/2;
+            const int viewY0 = (int)floor(playerPos.z) - VIEW_CELLS_Y/2;
+            bool inside = viewX0 >= tileX0 && viewY0 >= tileY0 &&
+                viewX0 + VIEW_CELLS_X <= tileX0 + TILE_CELLS_X && viewY0 + VIEW_CELLS_Y <= tileY0 + TILE_CELLS_Y;
+            if(!valid || tileMap != map || mapRevision != map->getRevision() ||
+                    exploredRevision != explored->getRevision() || !inside){
+                rasterize(map, explored, viewX0 - MARGIN, viewY0 - MARGIN);
+            }
+
+            //切り出して貼り付ける
+            for(int y=0; y<VIEW_CELLS_Y; y++){
+                const col::CHAR_INF *src = &tile.buffer[(viewY0 - tileY0 + y) * tile.width + (viewX0 - tileX0)*2];
+                col::CHAR_INF *dest = &sb->buffer[y * sb->width + screenX0];
+                std::copy(src, src + VIEW_CELLS_X*2, dest);
+            }
+
+            //ポータル(見つけていれば)とプレイヤーの印
+            int portalX = (int)floor(portalPos.x), portalY = (int)floor(portalPos.z);
+            if(explored->isExplored(portalX, portalY)){
+                putMarker(sb, screenX0, portalX - viewX0, portalY - viewY0,
+                    col::CHAR_INF(L'O', {col::YELLOW, true}, {col::BLACK, false}));
+            }
+            putMarker(sb, screenX0, (int)floor(playerPos.x) - viewX0, (int)floor(playerPos.z) - viewY0,
+                col::CHAR_INF(arrow(yaw), {col::GREEN, true}, {col::BLACK, false}));
+        }
+
+        void invalidate(){ valid = false; }
+
+    private:
+        //(originX,originY)からTILE_CELLS_X×TILE_CELLS_Yのマスを描く
+        void rasterize(const maze::Maze *map, const explore::ExploredMap *explored, int originX, int originY){
+            const col::CHAR_INF unknown(L' ', {col::WHITE, false}, {col::BLACK, false});
+            const col::CHAR_INF wall(L' ', {col::WHITE, false}, {col::WHITE, false});
+            const col::CHAR_INF floorCell(L'.', {col::WHITE, false}, {col::BLACK, false});
+            if(tile.width != TILE_CELLS_X*2) tile.reallocate(TILE_CELLS_X*2, TILE_CELLS_Y);
+            for(int y=0; y<TILE_CELLS_Y; y++){
+                for(int x=0; x<TILE_CELLS_X; x++){
+                    int mx = originX + x, my = originY + y;
+                    col::CHAR_INF cell = unknown;
+                    if(explored->isExplored(mx, my)) cell = (map->getNum(mx, my) == 0) ? floorCell : wall;
+                    tile.buffer[y * tile.width + x*2] = cell;
+                    tile.buffer[y * tile.width + x*2 + 1] = cell;
+                }
+            }
+            tileX0 = originX;
+            tileY0 = originY;
+            tileMap = map;
+            mapRevision = map->getRevision();
+            exploredRevision = explored->getRevision();
+            valid = true;
+        }
+
+        static void putMarker(ScreenBuffer *sb, int screenX0, int cellX, int cellY, const col::CHAR_INF &cell){
+            if(cellX < 0 || cellX >= VIEW_CELLS_X || cellY < 0 || cellY >= VIEW_CELLS_Y) return;
+            sb->buffer[cellY * sb->width + screenX0 + cellX*2] = cell;
+            sb->buffer[cellY * sb->width + screenX0 + cellX*2 + 1] = col::CHAR_INF(L' ', cell.fore, cell.back);
+        }
+
+        //向き(0でz+，地図では下向き)を矢印に
+        static wchar_t arrow(double yaw){
+            double fx = -sin(yaw), fz = cos(yaw);
+            if(fabs(fx) > fabs(fz)) return fx > 0 ? L'>' : L'<';
+            return fz > 0 ? L'v' : L'^';
+        }
+
+        ScreenBuffer tile;
+        int tileX0 = 0;
+        int tileY0 = 0;
+        const maze::Maze *tileMap = nullptr;
+        unsigned int mapRevision = 0;
+        unsigned int exploredRevision = 0;
+        bool valid = false;
+    };
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <cmath>
+#include <stdint.h>
+
+//レイキャストの数値型(double / float / 16.16固定小数点)をまとめて扱うための部品
+namespace num
+{
+    //16.16固定小数点．演算はint64で行い，はみ出したら飽和させる
+    //どの環境でも結果がビット単位で一致する
+    struct Fixed16 {
+        static const int SHIFT = 16;
+        static const int32_t ONE = 1 << SHIFT;
+        int32_t raw = 0;
+
+        Fixed16() = default;
+        explicit Fixed16(int v) : raw(saturate((int64_t)v * ONE)) {}
+
+        static Fixed16 fromRaw(int64_t r) { Fixed16 f; f.raw = saturate(r); return f; }
+        static int32_t saturate(int64_t v) {
+            if (v > INT32_MAX) return INT32_MAX;
+            if (v < -INT32_MAX) return -INT32_MAX;
+            return (int32_t)v;
+        }
+
+        Fixed16 operator+(Fixed16 o) const { return fromRaw((int64_t)raw + o.raw); }
+        Fixed16 operator-(Fixed16 o) const { return fromRaw((int64_t)raw - o.raw); }
+        Fixed16 operator*(Fixed16 o) const { return fromRaw(((int64_t)raw * o.raw) >> SHIFT); }
+        Fixed16 operator/(Fixed16 o) const {
+            if (o.raw == 0) return fromRaw(raw >= 0 ? INT32_MAX : -INT32_MAX);
+            return fromRaw(((int64_t)raw * ONE) / o.raw);
+        }
+        Fixed16 operator-() const { return fromRaw(-(int64_t)raw); }
+        Fixed16& operator+=(Fixed16 o) { return *this = *this + o; }
+        Fixed16& operator-=(Fixed16 o) { return *this = *this - o; }
+        Fixed16& operator*=(Fixed16 o) { return *this = *this * o; }
+        Fixed16& operator/=(Fixed16 o) { return *this = *this / o; }
+
+        bool operator<(Fixed16 o) const { return raw < o.raw; }
+        bool operator>(Fixed16 o) const { return raw > o.raw; }
+        bool operator<=(Fixed16 o) const { return raw <= o.raw; }
+        bool operator>=(Fixed16 o) const { return raw >= o.raw; }
+        bool operator==(Fixed16 o) const { return raw == o.raw; }
+        bool operator!=(Fixed16 o) const { return raw != o.raw; }
+    };
+
+    inline Fixed16 abs(Fixed16 v) { return v.raw < 0 ? -v : v; }
+    //整数の平方根(ビットごとに決める)．sqrt(raw/2^16)*2^16 = sqrt(raw*2^16)
+    inline Fixed16 sqrt(Fixed16 v) {
+        if (v.raw <= 0) return Fixed16();
+        uint64_t n = (uint64_t)v.raw << Fixed16::SHIFT;
+        uint64_t result = 0;
+        uint64_t bit = (uint64_t)1 << 62;
+        while (bit > n) bit >>= 2;
+        while (bit != 0) {
+            if (n >= result + bit) {
+                n -= result + bit;
+                result = (result >> 1) + bit;
+            } else {
+                result >>= 1;
+            }
+            bit >>= 2;
+        }
+        return Fixed16::fromRaw((int64_t)result);
+    }
+
+    //型ごとの変換と定数
+    template<typename T> struct Traits;
+
+    template<> struct Traits<double> {
+        static double fromDouble(double v) { return v; }
+        static double toDouble(double v) { return v; }
+        static int toInt(double v) { return (int)v; }
+        static double maxValue() { return 1e30; }
+        static double epsilon() { return 1e-9; }
+    };
+    template<> struct Traits<float> {
+        static float fromDouble(double v) { return (float)v; }
+        static double toDouble(float v) { return v; }
+        static int toInt(float v) { return (int)v; }
+        static float maxValue() { return 1e30f; }
+        static float epsilon() { return 1e-6f; }
+    };
+    template<> struct Traits<Fixed16> {
+        static Fixed16 fromDouble(double v) {
+            double r = v * Fixed16::ONE;
+            if (r >= (double)INT32_MAX) return Fixed16::fromRaw(INT32_MAX);
+            if (r <= -(double)INT32_MAX) return Fixed16::fromRaw(-INT32_MAX);
+            return Fixed16::fromRaw((int64_t)std::floor(r + 0.5));
+        }
+        static double toDouble(Fixed16 v) { return (double)v.raw / Fixed16::ONE; }
+        static int toInt(Fixed16 v) { return v.raw / Fixed16::ONE; }//0方向への切り捨て(doubleと同じ)
+        static Fixed16 maxValue() { return Fixed16::fromRaw(INT32_MAX); }
+        static Fixed16 epsilon() { return Fixed16::fromRaw(1); }
+    };
+
+    template<typename T> T fromDouble(double v) { return Traits<T>::fromDouble(v); }
+    template<typename T> double toDouble(T v) { return Traits<T>::toDouble(v); }
+    template<typename T> int toInt(T v) { return Traits<T>::toInt(v); }
+}
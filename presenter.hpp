@@ -0,0 +1,115 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include "console.hpp"
+#include "recorder.hpp"
+
+//端末への書き出しをゲームループから切り離す
+namespace present
+{
+    //ScreenBufferを3枚持ち，ゲーム側が書いた最新の1枚を別スレッドでConsole::drawに渡す
+    //受け渡しは真ん中の1枚の番号を原子的に入れ替えるだけで，どちらも相手を待たない
+    //端末が遅いときは渡しそびれた古いフレームを捨てるので，ゲームループの時間は書き出しに引きずられない
+    class Presenter{
+    public:
+        ~Presenter(){ stop(); }
+
+        void start(Console *target){
+            stop();
+            console = target;
+            running = true;
+            worker = std::thread([this](){ loop(); });
+        }
+
+        //書き出したフレームをrecorderにも渡す(startの前に呼ぶ．nullptrでやめる)
+        void setRecorder(record::Recorder *target){ recorder = target; }
+
+        //残っているフレームを書き出してからスレッドを止める(Console::restoreの前に呼ぶ)
+        void stop(){
+            if(!worker.joinable()) return;
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+                running = false;
+            }
+            wake.notify_one();
+            worker.join();
+        }
+
+        //frameを写して次に書き出すフレームにする．前に渡したフレームがまだ書かれていなければ捨てる
+        void submit(const ScreenBuffer &frame){
+            ScreenBuffer &slot = slots[back];
+            if(slot.width != frame.width || slot.height != frame.height) slot.reallocate(frame.width, frame.height);
+            std::copy(frame.buffer.begin(), frame.buffer.end(), slot.buffer.begin());
+
+            int previous = middle.exchange(back | NEW_FRAME, std::memory_order_acq_rel);
+            back = previous & INDEX_MASK;
+            submittedFrames++;
+            if(previous & NEW_FRAME) droppedFrames++;
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);//待ちに入る直前の取りこぼしを防ぐだけ
+            }
+            wake.notify_one();
+        }
+
+        //統計(どのスレッドから読んでもよい)
+        uint64_t getSubmittedFrames() const { return submittedFrames; }
+        uint64_t getPresentedFrames() const { return presentedFrames; }
+        uint64_t getDroppedFrames() const { return droppedFrames; }
+        //書き出し1回にかかった時間(マイクロ秒)．直近と最大と平均
+        uint64_t getLastWriteMicros() const { return lastWriteMicros; }
+        uint64_t getMaxWriteMicros() const { return maxWriteMicros; }
+        uint64_t getAverageWriteMicros() const {
+            uint64_t frames = presentedFrames;
+            return frames ? totalWriteMicros / frames : 0;
+        }
+
+    private:
+        static const int NEW_FRAME = 4;//middleに入っているのがまだ書かれていないフレーム
+        static const int INDEX_MASK = 3;
+
+        void loop(){
+            while(true){
+                {
+                    std::unique_lock<std::mutex> lock(wakeMutex);
+                    wake.wait(lock, [this](){ return !running || (middle.load(std::memory_order_acquire) & NEW_FRAME); });
+                    if(!running && !(middle.load(std::memory_order_acquire) & NEW_FRAME)) break;
+                }
+                front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+
+                std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+                console->draw(slots[front]);
+                uint64_t micros = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - begin).count();
+                lastWriteMicros = micros;
+                if(micros > maxWriteMicros) maxWriteMicros = micros;
+                totalWriteMicros += micros;
+                presentedFrames++;
+                if(recorder) recorder->addFrame(slots[front]);//書き出しの時間には含めない
+            }
+        }
+
+        Console *console = nullptr;
+        record::Recorder *recorder = nullptr;
+        ScreenBuffer slots[3];
+        int back = 0;                  //ゲーム側だけが触る
+        int front = 1;                 //書き出し側だけが触る
+        std::atomic<int> middle{2};    //受け渡し中の1枚(番号 | NEW_FRAME)
+
+        std::thread worker;
+        std::mutex wakeMutex;          //書き出し側を眠らせるためだけに使う
+        std::condition_variable wake;
+        bool running = false;
+
+        std::atomic<uint64_t> submittedFrames{0};
+        std::atomic<uint64_t> presentedFrames{0};
+        std::atomic<uint64_t> droppedFrames{0};
+        std::atomic<uint64_t> lastWriteMicros{0};
+        std::atomic<uint64_t> maxWriteMicros{0};
+        std::atomic<uint64_t> totalWriteMicros{0};
+    };
+}
@@ -1,25 +1,40 @@
 #pragma once
 #include <math.h>
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+#include <stdlib.h>
 #include "vec.hpp"
 #include "maze.hpp"
 namespace rayCast
 {
+    //レイキャストの数値型．ビルドごとにRAYCAST_FLOAT / RAYCAST_FIXEDで切り替える
+    //(floatはSIMDの幅が倍になり，16.16固定小数点はどの環境でも結果が一致する)
+#if defined(RAYCAST_FIXED)
+    typedef num::Fixed16 Scalar;
+#elif defined(RAYCAST_FLOAT)
+    typedef float Scalar;
+#else
+    typedef double Scalar;
+#endif
+
     //平面上のuv計算．normalは正規化されたものを使う
-    void calcUV(vec::vec3 encountPos, vec::vec3 planePos, vec::vec3 normal, vec::vec2 *uv){
-        const vec::vec3 up = {0.0, 1.0, 0.0};
+    template<typename T>
+    void calcUV(vec::basic_vec3<T> encountPos, vec::basic_vec3<T> planePos, vec::basic_vec3<T> normal, vec::basic_vec2<T> *uv){
+        const vec::basic_vec3<T> up = {T(0), T(1), T(0)};
         
-        vec::vec3 u;
-        if (normal.x * normal.x + normal.z * normal.z < 1e-6) {//完全に真上or真下
-            const vec::vec3 forward_axis = {1.0, 0.0, 0.0};
+        vec::basic_vec3<T> u;
+        if (normal.x * normal.x + normal.z * normal.z < num::fromDouble<T>(1e-6)) {//完全に真上or真下
+            const vec::basic_vec3<T> forward_axis = {T(1), T(0), T(0)};
             u = forward_axis.cross(normal);
         } else {
             u = up.cross(normal);
         }
 
         u.normalize();
-        vec::vec3 v = normal.cross(u);
+        vec::basic_vec3<T> v = normal.cross(u);
 
-        vec::vec3 d;
+        vec::basic_vec3<T> d;
         d = encountPos-planePos;
 
         uv->x = d.dot(u);
@@ -27,20 +42,22 @@ namespace rayCast
     }
 
     //平面との距離と交点座標計算，返り値がマイナスなら非接触
-    double sprite(vec::vec3 rayPos, vec::vec3 rayDir, vec::vec3 planePos, vec::vec3 planeNormal, vec::vec3 *encountPos){
-        double denominator = rayDir.dot(planeNormal);
+    template<typename T>
+    T sprite(vec::basic_vec3<T> rayPos, vec::basic_vec3<T> rayDir, vec::basic_vec3<T> planePos, vec::basic_vec3<T> planeNormal, vec::basic_vec3<T> *encountPos){
+        using std::abs;
+        T denominator = rayDir.dot(planeNormal);
 
         //内積がほぼ0の場合で平行
-        if (fabs(denominator) < 1e-6) {
-            return -1.0;
+        if (abs(denominator) < num::fromDouble<T>(1e-6)) {
+            return -T(1);
         }
 
-        vec::vec3 playerToPlane = planePos - rayPos;
+        vec::basic_vec3<T> playerToPlane = planePos - rayPos;
 
-        double t =playerToPlane.dot(planeNormal) / denominator;
+        T t =playerToPlane.dot(planeNormal) / denominator;
 
         // 距離tが負の場合、交点はプレイヤーの後ろ側
-        if (t >= 0) {
+        if (t >= T(0)) {
             encountPos->x = rayPos.x + rayDir.x * t;
             encountPos->y = rayPos.y + rayDir.y * t;
             encountPos->z = rayPos.z + rayDir.z * t;
@@ -49,98 +66,611 @@ namespace rayCast
         return t;
     }
 
-    typedef struct {
+    //壁以外のobjectID
+    const int OBJECT_CELLING = -1;
+    const int OBJECT_FLOOR = -2;
+    const int OBJECT_FOG = -3;//視界(viewDistance)の外
+
+    template<typename T>
+    struct BasicRaycastResult {
         bool didHit;
-        double distance;
+        T distance;
         int objectID;
         int hitSurface;
-        vec::vec3 hitPosition;
-    } RaycastResult;
+        vec::basic_vec3<T> hitPosition;
+        int cellX, cellY;//当たった壁のマス
+    };
+    typedef BasicRaycastResult<double> RaycastResult;
 
     //参考記事https://lodev.org/cgtutor/raycasting.html
     //２次元配列のマップに対して壁との距離と，X・Y平面のどちらにあたったかと，壁のナンバーを計算
-    RaycastResult map(maze::Maze *map, vec::vec3 playerPos, vec::vec3 rayDir,
-                    double heightFloor, double heightCelling){
-        int mapX = (int)playerPos.x;
-        int mapY = (int)playerPos.z;
+    //maxDistanceより先にしか壁がなければ打ち切ってdidHit=falseを返す．距離の単位はrayDirの長さ
+    template<typename T>
+    BasicRaycastResult<T> wall(maze::Maze *map, vec::basic_vec3<T> playerPos, vec::basic_vec3<T> rayDir, T maxDistance){
+        using std::abs;
+        const T zero = T(0);
+        const T one = T(1);
+        int mapX = num::toInt(playerPos.x);
+        int mapY = num::toInt(playerPos.z);
         
-        double deltaDistX = (rayDir.x == 0) ? 1e30 : fabs(1 / rayDir.x);
-        double deltaDistY = (rayDir.z == 0) ? 1e30 : fabs(1 / rayDir.z);
+        T deltaDistX = (rayDir.x == zero) ? num::Traits<T>::maxValue() : abs(one / rayDir.x);
+        T deltaDistY = (rayDir.z == zero) ? num::Traits<T>::maxValue() : abs(one / rayDir.z);
 
-        double sideDistX, sideDistY;
+        T sideDistX, sideDistY;
         int stepX, stepY;
 
-        if (rayDir.x < 0) {
+        if (rayDir.x < zero) {
             stepX = -1;
-            sideDistX = (playerPos.x - mapX) * deltaDistX;
+            sideDistX = (playerPos.x - T(mapX)) * deltaDistX;
         } else {
             stepX = 1;
-            sideDistX = (mapX + 1.0 - playerPos.x) * deltaDistX;
+            sideDistX = (T(mapX + 1) - playerPos.x) * deltaDistX;
         }
-        if (rayDir.z < 0) {
+        if (rayDir.z < zero) {
             stepY = -1;
-            sideDistY = (playerPos.z - mapY) * deltaDistY;
+            sideDistY = (playerPos.z - T(mapY)) * deltaDistY;
         } else {
             stepY = 1;
-            sideDistY = (mapY + 1.0 - playerPos.z) * deltaDistY;
+            sideDistY = (T(mapY + 1) - playerPos.z) * deltaDistY;
         }
 
-        bool hit = false;//当たり判定フラグ
-        int side;//X面(0)Y面(1)　どちらに当たったかのフラグ
-        int wallID;
+        BasicRaycastResult<T> value;
+        value.didHit = false;//当たり判定フラグ
+        value.distance = maxDistance;
+        value.hitSurface = 0;//X面(0)Y面(1)　どちらに当たったかのフラグ
+        value.objectID = 0;
+        value.hitPosition = playerPos;
+        value.cellX = value.cellY = -1;
 
-        while (hit == false) {
+        while (true) {
+            T enterDist;//次のマスに入る距離
+            int side;
             if (sideDistX < sideDistY) {//Xグリッドに当たった
+                enterDist = sideDistX;
                 sideDistX += deltaDistX;
                 mapX += stepX;
                 side = 0;
             } else {//Yグリッドに当たった
+                enterDist = sideDistY;
                 sideDistY += deltaDistY;
                 mapY += stepY;
                 side = 1;
             }
+            if (enterDist > maxDistance) break;//床か天井の方が近い
             
             //マスが壁かチェック
             int num = map->getNum(mapX, mapY);
             if (num > 0) {
-                hit = true;
-                wallID = num;
+                value.didHit = true;
+                value.distance = enterDist;
+                value.hitSurface = side;
+                value.objectID = num;
+                value.cellX = mapX;
+                value.cellY = mapY;
+                value.hitPosition = {playerPos.x + rayDir.x * enterDist,
+                                     playerPos.y + rayDir.y * enterDist,
+                                     playerPos.z + rayDir.z * enterDist};
+                break;
             }
         }
+        return value;
+    }
 
-        double perpWallDist;//壁までの垂直距離　魚眼効果補正
-        if (side == 0) {//X
-            //1ステップ分戻す
-            perpWallDist = (sideDistX - deltaDistX);
-        } else {//Y
-            perpWallDist = (sideDistY - deltaDistY);
+    //rayDirが正規化されていれば，床(-heightFloor)・天井(+heightCelling)までの距離
+    //水平な場合は最大値
+    template<typename T>
+    T floorCellingDistance(T rayDirY, T heightFloor, T heightCelling, int *objectID){
+        if(rayDirY > T(0)){
+            *objectID = OBJECT_CELLING;
+            return heightCelling / rayDirY;
+        }else if(rayDirY < T(0)){
+            *objectID = OBJECT_FLOOR;
+            return -heightFloor / rayDirY;
         }
+        *objectID = 0;
+        return num::Traits<T>::maxValue();
+    }
 
-        //床天井との当たり判定
-        double rayDirLength2D = sqrt(rayDir.x * rayDir.x + rayDir.z * rayDir.z);
-        double true3DWallDist = (rayDirLength2D > 1e-6) ? (perpWallDist / rayDirLength2D) : 1e30;
-        if(rayDir.y > 0){
-            double distCelling;
-            distCelling = (1.0 / rayDir.y) * heightCelling;
-            if(distCelling < true3DWallDist){
-                perpWallDist = distCelling;
-                wallID = -1; // 天井
-            }
-        }else if(rayDir.y < 0){
-            double distFloor;
-            distFloor = -(1.0 / rayDir.y) * heightFloor;
-            if(distFloor < true3DWallDist){
-                perpWallDist = distFloor;
-                wallID = -2; // 床
+    //床天井と壁のうち近い方を返す．床天井より奥の壁はDDAを途中で打ち切る
+    //viewDistanceより先は調べずに霧(OBJECT_FOG)を返すので，床が広くても1本あたりの手間は一定
+    template<typename T>
+    BasicRaycastResult<T> map(maze::Maze *map, vec::basic_vec3<T> playerPos, vec::basic_vec3<T> rayDir,
+                    T heightFloor, T heightCelling, T viewDistance = num::Traits<T>::maxValue()){
+        int floorID;
+        T floorDist = floorCellingDistance(rayDir.y, heightFloor, heightCelling, &floorID);
+        BasicRaycastResult<T> value = wall(map, playerPos, rayDir, std::min(floorDist, viewDistance));
+        if(!value.didHit){
+            if(floorDist <= viewDistance){
+                value.distance = floorDist;
+                value.objectID = floorID;
+            }else{
+                value.distance = viewDistance;
+                value.objectID = OBJECT_FOG;
             }
         }
-        
-        RaycastResult value;
-        value.didHit = hit;
-        value.distance = perpWallDist;
-        value.hitSurface = side;
-        value.objectID = wallID;
+        return value;
+    }
 
+    //doubleで受け取ってScalarで計算し，結果をdoubleに戻す(Scalarがdoubleなら変換は消える)
+    template<typename T>
+    RaycastResult wallAs(maze::Maze *map, vec::vec3 playerPos, vec::vec3 rayDir, double maxDistance){
+        BasicRaycastResult<T> r = wall(map, vec::convert<T>(playerPos), vec::convert<T>(rayDir), num::fromDouble<T>(maxDistance));
+        RaycastResult value;
+        value.didHit = r.didHit;
+        value.distance = num::toDouble(r.distance);
+        value.objectID = r.objectID;
+        value.hitSurface = r.hitSurface;
+        value.hitPosition = vec::convert<double>(r.hitPosition);
+        value.cellX = r.cellX;
+        value.cellY = r.cellY;
         return value;
     }
+    template<typename T>
+    double spriteAs(vec::vec3 rayPos, vec::vec3 rayDir, vec::vec3 planePos, vec::vec3 planeNormal, vec::vec3 *encountPos){
+        vec::basic_vec3<T> encount;
+        T t = sprite(vec::convert<T>(rayPos), vec::convert<T>(rayDir), vec::convert<T>(planePos), vec::convert<T>(planeNormal), &encount);
+        *encountPos = vec::convert<double>(encount);
+        return num::toDouble(t);
+    }
+    template<typename T>
+    void calcUVAs(vec::vec3 encountPos, vec::vec3 planePos, vec::vec3 normal, vec::vec2 *uv){
+        vec::basic_vec2<T> result;
+        calcUV(vec::convert<T>(encountPos), vec::convert<T>(planePos), vec::convert<T>(normal), &result);
+        *uv = vec::convert<double>(result);
+    }
+
+    //playerPosから周囲radiusマス以内で最も近い壁までの水平距離(最大radius)
+    //これより近い床天井は壁のDDAなしで確定できる
+    double clearance(maze::Maze *map, vec::vec3 playerPos, int radius){
+        int cx = (int)playerPos.x;
+        int cy = (int)playerPos.z;
+        double nearest2 = (double)radius * radius;
+        for(int y=cy-radius; y<=cy+radius; y++){
+            for(int x=cx-radius; x<=cx+radius; x++){
+                if(map->getNum(x, y) <= 0) continue;
+                //マス(x,y)の正方形までの距離
+                double dx = std::max(std::max(x - playerPos.x, 0.0), playerPos.x - (x + 1.0));
+                double dy = std::max(std::max(y - playerPos.z, 0.0), playerPos.z - (y + 1.0));
+                nearest2 = std::min(nearest2, dx*dx + dy*dy);
+            }
+        }
+        return sqrt(nearest2);
+    }
+
+    //見通し判定の問い合わせ．x,z平面上でfromからtoが見えるか
+    struct SightQuery{
+        vec::vec3 from;
+        vec::vec3 to;
+    };
+
+    //まとめて見通し判定をする．visibleのi番目のビットがqueries[i]の結果
+    //SIGHT_LANES本ずつ線分のDDAを並べて同時に進め，壁に当たったレーンはそこで止める
+    //(fromのマスは調べず，toのマスまでに壁があれば見えない)
+    void lineOfSight(const maze::Maze *map, const SightQuery *queries, int count, std::vector<uint64_t> *visible){
+        const int SIGHT_LANES = 8;
+        const int width = map->getWidth();
+        const int height = map->getHeight();
+        const int *data = map->getMapData();
+        visible->assign((count + 63) / 64, 0);
+
+        for(int base=0; base<count; base+=SIGHT_LANES){
+            int cell[SIGHT_LANES], stepX[SIGHT_LANES], stepY[SIGHT_LANES], remaining[SIGHT_LANES];
+            double tMaxX[SIGHT_LANES], tMaxY[SIGHT_LANES], tDeltaX[SIGHT_LANES], tDeltaY[SIGHT_LANES];
+            int clear[SIGHT_LANES];
+            int lanes = std::min(SIGHT_LANES, count - base);
+            int longest = 0;
+
+            for(int l=0; l<SIGHT_LANES; l++){
+                if(l >= lanes){//余ったレーンは何もしない
+                    cell[l] = 0; stepX[l] = stepY[l] = 0; remaining[l] = 0; clear[l] = 0;
+                    tMaxX[l] = tMaxY[l] = tDeltaX[l] = tDeltaY[l] = 0;
+                    continue;
+                }
+                const SightQuery &q = queries[base + l];
+                //マップの外はすべて壁なので，端点はマップ内に収める
+                double ax = std::min(std::max(q.from.x, 0.0), width - 1e-9);
+                double az = std::min(std::max(q.from.z, 0.0), height - 1e-9);
+                double bx = std::min(std::max(q.to.x, 0.0), width - 1e-9);
+                double bz = std::min(std::max(q.to.z, 0.0), height - 1e-9);
+                int cx = (int)ax, cz = (int)az;
+                int tx = (int)bx, tz = (int)bz;
+                double dx = bx - ax, dz = bz - az;
+
+                stepX[l] = (dx < 0) ? -1 : 1;
+                stepY[l] = (dz < 0) ? -width : width;
+                tDeltaX[l] = (dx == 0) ? 1e30 : fabs(1.0 / dx);
+                tDeltaY[l] = (dz == 0) ? 1e30 : fabs(1.0 / dz);
+                tMaxX[l] = ((dx < 0) ? (ax - cx) : (cx + 1.0 - ax)) * tDeltaX[l];
+                tMaxY[l] = ((dz < 0) ? (az - cz) : (cz + 1.0 - az)) * tDeltaY[l];
+                cell[l] = cz * width + cx;
+                remaining[l] = abs(tx - cx) + abs(tz - cz);//通過するマスの数
+                clear[l] = 1;
+                longest = std::max(longest, remaining[l]);
+            }
+
+            //全レーンを同じ手順で進める(分岐を減らして自動ベクトル化しやすくする)
+            for(int step=0; step<longest; step++){
+                int active = 0;
+                for(int l=0; l<SIGHT_LANES; l++){
+                    int moving = remaining[l] > 0;
+                    int useX = tMaxX[l] < tMaxY[l];
+                    int moveX = moving & useX;
+                    int moveY = moving & (1 - useX);
+                    cell[l] += moveX * stepX[l] + moveY * stepY[l];
+                    tMaxX[l] += moveX ? tDeltaX[l] : 0.0;
+                    tMaxY[l] += moveY ? tDeltaY[l] : 0.0;
+                    int wall = moving & (data[cell[l]] > 0);
+                    clear[l] &= 1 - wall;
+                    remaining[l] = wall ? 0 : remaining[l] - moving;//壁に当たったら打ち切り
+                    active |= remaining[l];
+                }
+                if(active == 0) break;
+            }
+
+            for(int l=0; l<lanes; l++){
+                if(clear[l]){
+                    int i = base + l;
+                    (*visible)[i / 64] |= (uint64_t)1 << (i % 64);
+                }
+            }
+        }
+    }
+
+    //見通し判定の結果を読む
+    inline bool isVisible(const std::vector<uint64_t> &visible, int index){
+        return ((visible[index / 64] >> (index % 64)) & 1) != 0;
+    }
+
+    //ある位置から水平に見た壁面の並び(角度順の区間)．位置が同じならヨーやピッチが変わっても使える
+    //各区間は1枚の壁面(x=coordまたはz=coordの平面)なので，距離は割り算1回で求まる
+    class WallProfile{
+    public:
+        struct Span{
+            double startAngle;//区間の始まり(0~2π，反時計回り)
+            double startX, startZ;//startAngleの向きの単位ベクトル
+            int side;//0:x=coordの面 1:z=coordの面
+            double coord;
+            int objectID;
+            int cellX, cellY;
+        };
+
+        //playerPosから全周を掃引し，見えている壁面を区間として並べる
+        //maxDistanceまでに壁のない向きがあるか，壁に接していて区間が決まらなければ
+        //作らずにfalseを返す(ピクセルごとのDDAに任せる)
+        bool build(maze::Maze *map, vec::vec3 playerPos, double maxDistance = 1e30){
+            const double TWO_PI = 6.283185307179586;
+            const double EPS = 1e-9;//これより細い区間は画面に映らない
+            const int MAX_STEPS = 1 << 16;//区間の数の上限(迷路の壁面の数よりずっと多い)
+            spans.clear();
+            origin = playerPos;
+            built = true;
+            //壁に接している(面や角の上に立っている)と，その面の端が真横になって区間が決まらない
+            if(clearance(map, playerPos, 1) <= EPS) return false;
+            double theta = 0.0;
+            for(int step=0; theta < TWO_PI; step++){
+                if(step >= MAX_STEPS){
+                    spans.clear();
+                    return false;
+                }
+                vec::vec3 dir = {cos(theta), 0.0, sin(theta)};
+                RaycastResult hit = wall(map, playerPos, dir, maxDistance);
+                if(!hit.didHit){
+                    spans.clear();
+                    return false;
+                }
+                Span span;
+                span.startAngle = theta;
+                span.startX = dir.x;
+                span.startZ = dir.z;
+                span.side = hit.hitSurface;
+                span.objectID = hit.objectID;
+                span.cellX = hit.cellX;
+                span.cellY = hit.cellY;
+
+                //壁面の両端の角度から，反時計回りにどこまでこの面が続くかを求める
+                double ax, az, bx, bz;
+                if(hit.hitSurface == 0){
+                    span.coord = (dir.x > 0) ? hit.cellX : hit.cellX + 1.0;
+                    ax = bx = span.coord;
+                    az = hit.cellY;
+                    bz = hit.cellY + 1.0;
+                }else{
+                    span.coord = (dir.z > 0) ? hit.cellY : hit.cellY + 1.0;
+                    az = bz = span.coord;
+                    ax = hit.cellX;
+                    bx = hit.cellX + 1.0;
+                }
+                double reachA = angleFrom(theta, ax - playerPos.x, az - playerPos.z);
+                double reachB = angleFrom(theta, bx - playerPos.x, bz - playerPos.z);
+                double endX = (reachA > reachB) ? ax : bx;
+                double endZ = (reachA > reachB) ? az : bz;
+                double reach = std::max(reachA, reachB);
+
+                //面の端より手前で別の壁の角が割り込むなら，そこで区間を切る
+                double eventX, eventZ;
+                if(reach > 0 && findOccluder(map, playerPos, dir, span, endX, endZ, &eventX, &eventZ)){
+                    reach = angleFrom(theta, eventX, eventZ);
+                }
+
+                //区間が進まなければ(丸め誤差で壁に接しているのと同じになったとき)作らない
+                if(reach <= EPS){
+                    spans.clear();
+                    return false;
+                }
+
+                if(spans.empty() || !sameFace(spans.back(), span)){
+                    spans.push_back(span);
+                }
+                theta += reach + EPS;
+            }
+            return true;
+        }
+
+        //線分の索引を使ってプレイヤーに近いブロックから順に線分を角度方向のバッファへ投影する
+        //全周が埋まり，残りのブロックがどれも埋まった面より遠いか，maxDistanceより遠ければそこで打ち切る
+        //(埋まらなかった向きは霧になる)
+        void buildFromSegments(const maze::Maze *map, vec::vec3 playerPos, double maxDistance = 1e30){
+            const double TWO_PI = 6.283185307179586;
+            const std::vector<maze::WallSegment> &segments = map->getSegments();
+            const int B = maze::Maze::SEGMENT_BLOCK;
+            origin = playerPos;
+            built = true;
+            if(segmentStamp.size() != segments.size()){
+                segmentStamp.assign(segments.size(), 0);
+                stampCounter = 0;
+            }
+            stampCounter++;
+
+            spans.clear();
+            Span none = {};
+            none.objectID = 0;//何も映っていない区間
+            pushSpan(spans, none, 0.0);
+
+            int pbx = (int)floor(playerPos.x) / B;
+            int pby = (int)floor(playerPos.z) / B;
+            int maxRing = std::max(std::max(pbx, map->getBlockCountX() - 1 - pbx),
+                                   std::max(pby, map->getBlockCountY() - 1 - pby));
+            for(int ring=0; ring<=maxRing; ring++){
+                for(int by=pby-ring; by<=pby+ring; by++){
+                    for(int bx=pbx-ring; bx<=pbx+ring; bx++){
+                        if(std::max(abs(bx-pbx), abs(by-pby)) != ring) continue;//輪の上のブロックだけ
+                        for(int index : map->getSegmentsInBlock(bx, by)){
+                            if(segmentStamp[index] == stampCounter) continue;
+                            segmentStamp[index] = stampCounter;
+                            projectSegment(segments[index], index, playerPos, TWO_PI);
+                        }
+                    }
+                }
+                //次の輪のブロックは少なくともring*Bだけ離れている
+                if((double)ring * B > maxDistance) break;
+                if(isCovered() && farthestDepth() <= (double)ring * B) break;
+            }
+        }
+
+        //この位置で作ったか(作れなかった場合も含む)
+        bool isBuiltFor(vec::vec3 playerPos) const {
+            return built && origin.x == playerPos.x && origin.y == playerPos.y && origin.z == playerPos.z;
+        }
+        void invalidate(){ spans.clear(); built = false; }
+
+        //水平方向(dirX, dirZ)を含む区間の番号．角度の計算が要るので行の先頭でだけ使う
+        int find(double dirX, double dirZ) const {
+            double angle = atan2(dirZ, dirX);
+            if(angle < 0) angle += 6.283185307179586;
+            int lo = 0, hi = (int)spans.size() - 1;
+            while(lo < hi){
+                int mid = (lo + hi + 1) / 2;
+                if(spans[mid].startAngle <= angle) lo = mid;
+                else hi = mid - 1;
+            }
+            return lo;
+        }
+        //直前の区間番号から少しだけ回った方向の区間番号を求める(外積の符号だけで進める)
+        int advance(int index, double dirX, double dirZ) const {
+            int n = (int)spans.size();
+            for(int i=0; i<n; i++){
+                const Span &cur = spans[index];
+                if(cur.startX*dirZ - cur.startZ*dirX < 0){
+                    index = (index + n - 1) % n;//時計回り側に戻る
+                    continue;
+                }
+                const Span &next = spans[(index + 1) % n];
+                if(next.startX*dirZ - next.startZ*dirX >= 0){
+                    index = (index + 1) % n;//反時計回り側に進む
+                    continue;
+                }
+                break;
+            }
+            return index;
+        }
+
+        //区間の壁面までの距離(rayDirの長さが単位)．壁面と平行なら1e30
+        double distance(int index, vec::vec3 rayDir) const {
+            const Span &span = spans[index];
+            if(span.objectID == 0) return 1e30;
+            return distanceTo(span, rayDir);
+        }
+
+        //距離distanceで区間の壁面に当たったときの壁のマス(線分の区間は何マスにもまたがる)
+        void hitCell(int index, vec::vec3 rayDir, double distance, int *cellX, int *cellY) const {
+            const Span &span = spans[index];
+            int wallCell = (int)span.coord - (((span.side == 0) ? rayDir.x : rayDir.z) > 0 ? 0 : 1);
+            if(span.side == 0){
+                *cellX = wallCell;
+                *cellY = (int)floor(origin.z + rayDir.z * distance);
+            }else{
+                *cellX = (int)floor(origin.x + rayDir.x * distance);
+                *cellY = wallCell;
+            }
+        }
+
+        const Span& get(int index) const { return spans[index]; }
+        bool empty() const { return spans.empty(); }
+
+    private:
+        //角度thetaの向きから見て(x,z)が反時計回りに何ラジアン先か(-π~π)
+        static double angleFrom(double theta, double x, double z){
+            double d = atan2(z, x) - theta;
+            const double PI = 3.141592653589793;
+            while(d > PI) d -= 2*PI;
+            while(d <= -PI) d += 2*PI;
+            return d;
+        }
+        static bool sameFace(const Span &a, const Span &b){
+            return a.side == b.side && a.coord == b.coord && a.cellX == b.cellX && a.cellY == b.cellY;
+        }
+
+        //dirから面の端(endX,endZ)までの扇形の中で，面より手前にある壁の角のうち最も手前の向きのもの
+        //見える面が切り替わるのは必ずこのような角なので，見つかればそこまでで区間を切る
+        static bool findOccluder(maze::Maze *map, vec::vec3 p, vec::vec3 dir, const Span &face,
+                double endX, double endZ, double *eventX, double *eventZ){
+            double ex = endX - p.x, ez = endZ - p.z;
+            //扇形(プレイヤーと面の両端を含む範囲)を囲むマス
+            int minX = (int)floor(std::min(p.x, std::min(endX, face.side == 0 ? face.coord : (double)face.cellX))) - 1;
+            int maxX = (int)floor(std::max(p.x, std::max(endX, face.side == 0 ? face.coord : face.cellX + 1.0))) + 1;
+            int minZ = (int)floor(std::min(p.z, std::min(endZ, face.side == 1 ? face.coord : (double)face.cellY))) - 1;
+            int maxZ = (int)floor(std::max(p.z, std::max(endZ, face.side == 1 ? face.coord : face.cellY + 1.0))) + 1;
+            double playerSide = (face.side == 0) ? p.x - face.coord : p.z - face.coord;
+
+            bool found = false;
+            double bestX = 0, bestZ = 0;
+            for(int y=minZ; y<=maxZ; y++){
+                for(int x=minX; x<=maxX; x++){
+                    if(map->getNum(x, y) <= 0) continue;
+                    for(int c=0; c<4; c++){
+                        double cx = x + (c & 1) - p.x;
+                        double cz = y + (c >> 1) - p.z;
+                        //面より手前(プレイヤー側)にある角だけ
+                        double cornerSide = (face.side == 0) ? cx + p.x - face.coord : cz + p.z - face.coord;
+                        if(cornerSide * playerSide <= 0) continue;
+                        //dirより反時計回り側，面の端より時計回り側
+                        if(dir.x*cz - dir.z*cx <= 0) continue;
+                        if(cx*ez - cz*ex <= 0) continue;
+                        if(!found || bestX*cz - bestZ*cx < 0){
+                            bestX = cx;
+                            bestZ = cz;
+                            found = true;
+                        }
+                    }
+                }
+            }
+            *eventX = bestX;
+            *eventZ = bestZ;
+            return found;
+        }
+
+        //線分を角度の区間に直して挿入する．裏向きの線分は見えないので飛ばす
+        void projectSegment(const maze::WallSegment &seg, int index, vec::vec3 p, double twoPi){
+            double playerCoord = (seg.axis == 0) ? p.x : p.z;
+            if((playerCoord - seg.coord) * seg.facing <= 0) return;
+            double ax, az, bx, bz;
+            if(seg.axis == 0){
+                ax = bx = seg.coord;
+                az = seg.from;
+                bz = seg.to;
+            }else{
+                az = bz = seg.coord;
+                ax = seg.from;
+                bx = seg.to;
+            }
+            double a0 = atan2(az - p.z, ax - p.x);
+            if(a0 < 0) a0 += twoPi;
+            double width = angleFrom(a0, bx - p.x, bz - p.z);
+            if(width < 0){
+                a0 = atan2(bz - p.z, bx - p.x);
+                if(a0 < 0) a0 += twoPi;
+                width = -width;
+            }
+            Span face = {};
+            face.side = seg.axis;
+            face.coord = seg.coord;
+            face.objectID = seg.objectID;
+            face.cellX = index;//線分から作った区間では線分番号で面を区別する
+            face.cellY = -1;
+            if(a0 + width > twoPi){
+                insertFace(a0, twoPi, face);
+                insertFace(0.0, a0 + width - twoPi, face);
+            }else{
+                insertFace(a0, a0 + width, face);
+            }
+        }
+
+        //[a0,a1)の範囲で，今ある面よりfaceの方が近いところを置き換える
+        //壁の線分は交差しないので，重なった範囲の真ん中で比べれば範囲全体の前後が決まる
+        void insertFace(double a0, double a1, const Span &face){
+            const double TWO_PI = 6.283185307179586;
+            if(a1 <= a0) return;
+            scratch.clear();
+            int n = (int)spans.size();
+            for(int i=0; i<n; i++){
+                double s0 = spans[i].startAngle;
+                double s1 = (i+1 < n) ? spans[i+1].startAngle : TWO_PI;
+                if(s1 <= a0 || s0 >= a1){
+                    pushSpan(scratch, spans[i], s0);
+                    continue;
+                }
+                if(s0 < a0) pushSpan(scratch, spans[i], s0);
+                double o0 = std::max(s0, a0);
+                double o1 = std::min(s1, a1);
+                double mid = (o0 + o1) * 0.5;
+                bool closer = spans[i].objectID == 0 ||
+                    horizontalDepth(face, mid) < horizontalDepth(spans[i], mid);
+                pushSpan(scratch, closer ? face : spans[i], o0);
+                if(s1 > a1) pushSpan(scratch, spans[i], a1);
+            }
+            spans.swap(scratch);
+        }
+
+        //startから始まる区間として追加する．直前と同じ面ならつなげる
+        static void pushSpan(std::vector<Span> &list, const Span &face, double start){
+            if(!list.empty()){
+                const Span &last = list.back();
+                if(last.objectID == 0 && face.objectID == 0) return;
+                if(last.objectID != 0 && face.objectID != 0 && sameFace(last, face)) return;
+            }
+            Span span = face;
+            span.startAngle = start;
+            span.startX = cos(start);
+            span.startZ = sin(start);
+            list.push_back(span);
+        }
+
+        double horizontalDepth(const Span &span, double angle) const {
+            vec::vec3 dir = {cos(angle), 0.0, sin(angle)};
+            return distanceTo(span, dir);
+        }
+        double distanceTo(const Span &span, vec::vec3 dir) const {
+            double d = (span.side == 0) ? dir.x : dir.z;
+            double o = (span.side == 0) ? origin.x : origin.z;
+            if(fabs(d) < 1e-12) return 1e30;
+            double t = (span.coord - o) / d;
+            return (t < 0) ? 1e30 : t;
+        }
+
+        bool isCovered() const {
+            for(const Span &span : spans){
+                if(span.objectID == 0) return false;
+            }
+            return true;
+        }
+        //区間の両端での距離の最大(直線までの距離は区間の端で最大になる)
+        double farthestDepth() const {
+            const double TWO_PI = 6.283185307179586;
+            double farthest = 0.0;
+            int n = (int)spans.size();
+            for(int i=0; i<n; i++){
+                double s1 = (i+1 < n) ? spans[i+1].startAngle : TWO_PI;
+                farthest = std::max(farthest, horizontalDepth(spans[i], spans[i].startAngle));
+                farthest = std::max(farthest, horizontalDepth(spans[i], s1));
+            }
+            return farthest;
+        }
+
+        std::vector<Span> spans;
+        std::vector<Span> scratch;
+        std::vector<unsigned> segmentStamp;
+        unsigned stampCounter = 0;
+        vec::vec3 origin;
+        bool built = false;
+    };
 }
\ No newline at end of file
@@ -0,0 +1,293 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include "console.hpp"
+
+//画面に出したフレームの記録と再生
+//ファイルは "MZRC" + 版数のあとにブロックが並ぶ．ブロックは [元の大きさ u32][圧縮後の大きさ u32][LZ圧縮したデータ]
+//ブロックの中身はフレームの並びで，フレームは前のフレームから変わったセルの連なりだけを持つ
+//  フレーム : 前のフレームからの時間(μs) 幅 高さ 連なりの数 連なり...
+//  連なり   : 前の連なりからの行の差 行頭(同じ行なら前の連なりの終わり)からの列の差 セルの数 (属性値 文字)...
+//  属性値は前景の色番号 | 背景の色番号<<8
+//数はすべて可変長(7bitずつ)．フレームがブロックをまたぐことはない
+namespace record
+{
+    static const char MAGIC[4] = {'M', 'Z', 'R', 'C'};
+    static const uint32_t VERSION = 2;
+    //再生で受け付ける画面の大きさ．壊れたファイルで巨大な確保をしないように
+    static const uint32_t MAX_SCREEN_SIDE = 4096;
+    static const uint32_t MAX_SCREEN_CELLS = 1 << 22;
+    static const uint32_t MAX_BLOCK_BYTES = 1 << 26;//ブロックの元の大きさ・圧縮後の大きさの上限
+
+    inline void putVarint(std::vector<uint8_t> &out, uint32_t v){
+        while(v >= 0x80){
+            out.push_back((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((uint8_t)v);
+    }
+    //読めなければfalse(posは進めない)
+    inline bool getVarint(const uint8_t *data, size_t size, size_t &pos, uint32_t &v){
+        uint32_t result = 0;
+        for(size_t i=pos, shift=0; i<size && shift<35; i++, shift+=7){
+            result |= (uint32_t)(data[i] & 0x7F) << shift;
+            if(!(data[i] & 0x80)){
+                pos = i + 1;
+                v = result;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //LZ77による圧縮．並びは [リテラルの数][リテラル][一致の長さ][一致の距離] の繰り返しで
+    //最後だけ一致の長さを0にして終わる．同じ行の色や空白が何度も出てくる差分はよく縮む
+    namespace lz
+    {
+        static const int HASH_BITS = 14;
+        static const int MIN_MATCH = 4;
+        static const size_t MAX_DISTANCE = 1 << 16;
+
+        inline uint32_t read32(const uint8_t *p){
+            uint32_t v;
+            memcpy(&v, p, 4);
+            return v;
+        }
+
+        inline void compress(const uint8_t *src, size_t size, std::vector<uint8_t> &out){
+            std::vector<int32_t> table((size_t)1 << HASH_BITS, -1);//4バイトの並び → 最後に出てきた位置
+            size_t literalStart = 0;
+            size_t i = 0;
+            while(i + MIN_MATCH <= size){
+                uint32_t key = read32(src + i);
+                uint32_t h = (key * 2654435761u) >> (32 - HASH_BITS);
+                int32_t candidate = table[h];
+                table[h] = (int32_t)i;
+                if(candidate < 0 || i - candidate > MAX_DISTANCE || read32(src + candidate) != key){
+                    i++;
+                    continue;
+                }
+                size_t length = MIN_MATCH;
+                while(i + length < size && src[candidate + length] == src[i + length]) length++;
+
+                putVarint(out, (uint32_t)(i - literalStart));
+                out.insert(out.end(), src + literalStart, src + i);
+                putVarint(out, (uint32_t)length);
+                putVarint(out, (uint32_t)(i - candidate));
+                i += length;
+                literalStart = i;
+            }
+            putVarint(out, (uint32_t)(size - literalStart));
+            out.insert(out.end(), src + literalStart, src + size);
+            putVarint(out, 0);
+        }
+
+        //rawSizeバイトに戻す．壊れていればfalse
+        inline bool decompress(const uint8_t *src, size_t size, size_t rawSize, std::vector<uint8_t> &out){
+            out.clear();
+            out.reserve(rawSize);
+            size_t pos = 0;
+            while(true){
+                uint32_t literals, length, distance;
+                if(!getVarint(src, size, pos, literals) || literals > size - pos || out.size() + literals > rawSize) return false;
+                out.insert(out.end(), src + pos, src + pos + literals);
+                pos += literals;
+                if(!getVarint(src, size, pos, length)) return false;
+                if(length == 0) return out.size() == rawSize;
+                if(!getVarint(src, size, pos, distance) || distance == 0 || distance > out.size() || out.size() + length > rawSize) return false;
+                size_t from = out.size() - distance;
+                for(uint32_t k=0; k<length; k++) out.push_back(out[from + k]);//重なってもよいので1バイトずつ
+            }
+        }
+    }
+
+    //Console::drawに渡したフレームを差分にして書き込む
+    class Recorder{
+    public:
+        static const size_t BLOCK_BYTES = 1 << 18;//これだけ溜まったら圧縮して書き出す
+        static const int RUN_GAP = 2;
+
+        ~Recorder(){ close(); }
+
+        bool open(const char *path){
+            close();
+            file = fopen(path, "wb");
+            if(!file) return false;
+            fwrite(MAGIC, 1, 4, file);
+            writeU32(VERSION);
+            start = std::chrono::steady_clock::now();
+            lastMicros = 0;
+            previous = PlanarScreenBuffer();
+            raw.clear();
+            return true;
+        }
+
+        bool isOpen() const { return file != nullptr; }
+
+        //screenを記録する．時刻はopenからの経過時間
+        void addFrame(const ScreenBuffer &screen){
+            if(!file) return;
+            uint64_t now = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            if(previous.width != screen.width || previous.height != screen.height){
+                previous.reallocate(screen.width, screen.height);//大きさが変わったら空白の画面との差分
+            }
+            current.assign(screen);
+            findDirtyRuns(previous, current, RUN_GAP, runs);
+
+            putVarint(raw, (uint32_t)(now - lastMicros));
+            putVarint(raw, (uint32_t)screen.width);
+            putVarint(raw, (uint32_t)screen.height);
+            putVarint(raw, (uint32_t)runs.size());
+            int y = 0, x = 0;
+            for(size_t i=0; i<runs.size(); i++){
+                const DirtyRun &run = runs[i];
+                if(run.y != y) x = 0;
+                putVarint(raw, (uint32_t)(run.y - y));
+                putVarint(raw, (uint32_t)(run.x0 - x));
+                putVarint(raw, (uint32_t)(run.x1 - run.x0));
+                for(int id = run.y * screen.width + run.x0; id < run.y * screen.width + run.x1; id++){
+                    putVarint(raw, current.attrs[id]);
+                    putVarint(raw, (uint32_t)current.chars[id]);
+                }
+                y = run.y;
+                x = run.x1;
+            }
+            lastMicros = now;
+            std::swap(previous, current);
+            frames++;
+            if(raw.size() >= BLOCK_BYTES) flushBlock();
+        }
+
+        void close(){
+            if(!file) return;
+            flushBlock();
+            fclose(file);
+            file = nullptr;
+        }
+
+        uint64_t getFrames() const { return frames; }
+        uint64_t getRawBytes() const { return rawBytes + raw.size(); }
+        uint64_t getWrittenBytes() const { return writtenBytes; }
+
+    private:
+        void flushBlock(){
+            if(raw.empty()) return;
+            packed.clear();
+            lz::compress(raw.data(), raw.size(), packed);
+            writeU32((uint32_t)raw.size());
+            writeU32((uint32_t)packed.size());
+            fwrite(packed.data(), 1, packed.size(), file);
+            rawBytes += raw.size();
+            writtenBytes += 8 + packed.size();
+            raw.clear();
+        }
+        void writeU32(uint32_t v){
+            uint8_t bytes[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24)};
+            fwrite(bytes, 1, 4, file);
+        }
+
+        FILE *file = nullptr;
+        std::chrono::steady_clock::time_point start;
+        uint64_t lastMicros = 0;
+        PlanarScreenBuffer previous;
+        PlanarScreenBuffer current;
+        std::vector<DirtyRun> runs;
+        std::vector<uint8_t> raw;   //圧縮前のブロック
+        std::vector<uint8_t> packed;
+        uint64_t frames = 0;
+        uint64_t rawBytes = 0;
+        uint64_t writtenBytes = 0;
+    };
+
+    //Recorderが書いたファイルを頭から1フレームずつ戻す
+    class Player{
+    public:
+        ~Player(){ close(); }
+
+        bool open(const char *path){
+            close();
+            file = fopen(path, "rb");
+            if(!file) return false;
+            char magic[4];
+            uint32_t version;
+            if(fread(magic, 1, 4, file) != 4 || memcmp(magic, MAGIC, 4) != 0 || !readU32(version) || version != VERSION){
+                close();
+                return false;
+            }
+            raw.clear();
+            pos = 0;
+            micros = 0;
+            return true;
+        }
+
+        //次のフレームをscreenに重ねる(screenには前のフレームが入っていること)
+        //timeは録画を始めてからの秒．終わりか壊れていればfalse
+        bool next(ScreenBuffer &screen, double &time){
+            if(!file) return false;
+            if(pos >= raw.size() && !readBlock()) return false;
+
+            const uint8_t *data = raw.data();
+            const size_t size = raw.size();
+            uint32_t dt, width, height, runCount;
+            if(!getVarint(data, size, pos, dt) || !getVarint(data, size, pos, width) ||
+                    !getVarint(data, size, pos, height) || !getVarint(data, size, pos, runCount)) return false;
+            if(width > MAX_SCREEN_SIDE || height > MAX_SCREEN_SIDE || width * height > MAX_SCREEN_CELLS) return false;
+            if((int)width != screen.width || (int)height != screen.height) screen.reallocate((int)width, (int)height);
+            uint32_t y = 0, x = 0;
+            for(uint32_t r=0; r<runCount; r++){
+                uint32_t dy, dx, length;
+                if(!getVarint(data, size, pos, dy) || !getVarint(data, size, pos, dx) || !getVarint(data, size, pos, length)) return false;
+                //足す前に残りと比べる(足してから比べると大きな値で桁あふれする)．xはいつもwidth以下
+                if(dy != 0) x = 0;
+                if(dy >= height - y) return false;
+                y += dy;
+                if(dx > width - x) return false;
+                x += dx;
+                if(length > width - x) return false;
+                col::CHAR_INF *cell = &screen.buffer[y * width + x];
+                for(uint32_t k=0; k<length; k++){
+                    uint32_t attr, c;
+                    if(!getVarint(data, size, pos, attr) || !getVarint(data, size, pos, c)) return false;
+                    cell[k].charactor = (wchar_t)c;
+                    cell[k].setAttributes((unsigned short)attr);
+                }
+                x += length;
+            }
+            micros += dt;
+            time = micros / 1e6;
+            return true;
+        }
+
+        void close(){
+            if(file) fclose(file);
+            file = nullptr;
+        }
+
+    private:
+        bool readBlock(){
+            uint32_t rawSize, packedSize;
+            if(!readU32(rawSize) || !readU32(packedSize)) return false;
+            if(rawSize > MAX_BLOCK_BYTES || packedSize > MAX_BLOCK_BYTES) return false;
+            packed.resize(packedSize);
+            if(fread(packed.data(), 1, packedSize, file) != packedSize) return false;
+            pos = 0;
+            return lz::decompress(packed.data(), packed.size(), rawSize, raw);
+        }
+        bool readU32(uint32_t &v){
+            uint8_t bytes[4];
+            if(fread(bytes, 1, 4, file) != 4) return false;
+            v = (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+            return true;
+        }
+
+        FILE *file = nullptr;
+        std::vector<uint8_t> packed;
+        std::vector<uint8_t> raw;  //展開したブロック
+        size_t pos = 0;
+        uint64_t micros = 0;
+    };
+}
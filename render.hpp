@@ -2,43 +2,363 @@
 #include <cmath>
 #include <stdlib.h>
 #include <algorithm>
+#include <type_traits>
 #include "vec.hpp"
 #include "maze.hpp"
 #include "console.hpp"
 #include "player.hpp"
 #include "rayCast.hpp"
 #include "design.hpp"
+#include "lightMap.hpp"
+#include "explored.hpp"
 
 namespace render
 {
-    void setBuffer(Player *player, maze::Maze *map, ScreenBuffer *sb,
-            vec::vec3 portalPos, vec::vec3 portalNormal){
+    //画面の1行分の床天井情報．ピッチが決まれば行だけで決まる
+    struct RowCast{
+        double floorParam;//正規化前のレイ方向を単位とした床天井までの距離(水平なら1e30)
+        int objectID;//-1:天井 -2:床 0:水平
+        double rayZ;//ヨー回転前のレイ方向のz成分(水平距離の計算用)
+    };
 
+    //壁の求め方．setBufferの中で切り替えて見比べられる
+    enum class RenderMode{
+        Raycast,//ピクセルごとのDDA(動いていない間は壁の並びを使い回す)
+        Segment,//まとめた壁の線分を投影して壁の並びを毎回作る(Scalarがdoubleのビルドだけ)
+    };
+
+    //ポータルの出口．リングの内側に当たったレイはここから続きを描く
+    struct PortalTarget{
+        maze::Maze *map = nullptr;//出口のある迷路(次の階)
+        vec::vec3 pos;//出口の中心
+        vec::vec3 forward;//出口から出ていく水平な向き(正規化)
+    };
+
+    //フレームをまたいで使い回す描画用のデータ
+    struct RenderContext{
+        RenderMode mode = RenderMode::Raycast;
+        design::ShadingTable shading;
+        lighting::LightMap light;//階が変わったら焼き直し，壁が壊されたらその周りだけ焼く
+        //あれば，レイが当たったマス(壁と床天井)に探索済みの印を付ける
+        explore::ExploredMap *explored = nullptr;
+        std::vector<RowCast> rows;
+
+        //位置が前フレームと同じ間(視点の回転だけ)は，水平方向の壁の並びを使い回す
+        rayCast::WallProfile profile;
+        const maze::Maze *profileMap = nullptr;
+        unsigned int profileRevision = 0;
+        RenderMode profileMode = RenderMode::Raycast;
+        double profileViewDistance = 0.0;
+        vec::vec3 lastPos;
+        bool hasLastPos = false;
+
+        //ポータルの先の描画．1フレームでくぐらせるレイの数と，くぐる回数に上限を設け
+        //超えた分は出口から見た低解像度のスナップショットで代用する
+        int portalMaxDepth = 1;
+        int portalRayBudget = 4000;
+        int portalRaysLeft = 0;
+        int portalRaysUsed = 0;//直近のフレームの統計
+        int portalFallbacks = 0;
+        lighting::LightMap portalLight;//出口側の迷路の明るさ
+        ScreenBuffer portalSnapshot;
+        const maze::Maze *snapshotMap = nullptr;
+        unsigned int snapshotRevision = 0;
+        vec::vec3 snapshotPos, snapshotForward;
+        double snapshotViewDistance = 0.0;
+    };
+
+    static_assert(lighting::LightMap::LEVELS == design::ShadingTable::LIGHT_LEVELS, "明るさの段階数をそろえる");
+
+    const double HEIGHT_FLOOR = 0.4;
+    const double HEIGHT_CELLING = 0.8;
+    const double SCREEN_OFFSET = 2.0;
+
+    //画面のuv(-1~1)
+    inline double screenU(int x, const ScreenBuffer *sb){
+        return (x*2.-sb->width)/std::min<int>(sb->height, sb->width);
+    }
+    inline double screenV(int y, const ScreenBuffer *sb){
+        return (sb->height - y*2.0)/std::min<int>(sb->height, sb->width);
+    }
+
+    //正規化前のレイ方向(uvX, uvY, offSet)をピッチ回転したときのyは行だけで決まるので
+    //床天井までの距離を行ごとに一度だけ求めておく
+    void buildRowTable(RenderContext *ctx, double pitch, const ScreenBuffer *sb){
+        ctx->rows.resize(sb->height);
         for (int y = 0; y < sb->height; y++) {
+            double rayY = screenV(y, sb);
+            double rayZ = SCREEN_OFFSET;
+            vec::rotate(rayY, rayZ, pitch);
+            RowCast &row = ctx->rows[y];
+            row.floorParam = rayCast::floorCellingDistance(rayY, HEIGHT_FLOOR, HEIGHT_CELLING, &row.objectID);
+            row.rayZ = rayZ;
+        }
+    }
+
+    //壁の並びはdoubleで求めるので，Scalarがfloatや固定小数点のビルドでは使わない
+    //(使うと止まっている間だけdoubleで描かれ，動いたときと結果が変わる)
+    const bool PROFILE_ENABLED = std::is_same<rayCast::Scalar, double>::value;
+
+    //位置が前フレームから動いていなければ壁の並びを(必要なら作って)使う
+    //線分モードでは毎フレーム壁の並びで描く
+    bool prepareProfile(RenderContext *ctx, maze::Maze *map, vec::vec3 pos){
+        if(!PROFILE_ENABLED) return false;//どちらのモードでもピクセルごとのDDAで描く
+        double viewDistance = ctx->shading.getViewDistance();
+        bool stationary = ctx->hasLastPos && ctx->profileMap == map && ctx->profileRevision == map->getRevision() &&
+            ctx->profileMode == ctx->mode &&
+            ctx->profileViewDistance == viewDistance &&
+            pos.x == ctx->lastPos.x && pos.y == ctx->lastPos.y && pos.z == ctx->lastPos.z;
+        ctx->lastPos = pos;
+        ctx->hasLastPos = true;
+        ctx->profileMap = map;
+        ctx->profileRevision = map->getRevision();
+        ctx->profileMode = ctx->mode;
+        ctx->profileViewDistance = viewDistance;
+        if(ctx->mode == RenderMode::Segment){
+            if(!stationary || !ctx->profile.isBuiltFor(pos)){
+                ctx->profile.buildFromSegments(map, pos, viewDistance);
+            }
+            return true;
+        }
+        if(!stationary){
+            ctx->profile.invalidate();
+            return false;
+        }
+        if(!ctx->profile.isBuiltFor(pos)){
+            ctx->profile.build(map, pos, viewDistance);
+        }
+        return !ctx->profile.empty();//視界内に壁のない向きがあれば作れていない
+    }
+
+    //ポータルのある迷路と，その位置と出口
+    struct PortalPass{
+        const maze::Maze *home;
+        vec::vec3 pos;
+        vec::vec3 normal;
+        const PortalTarget *target;
+    };
+
+    const int PORTAL_SNAPSHOT_WIDTH = 64;
+    const int PORTAL_SNAPSHOT_HEIGHT = 32;
+
+    //水平な向きforwardの右手側
+    inline vec::vec3 portalRight(vec::vec3 forward){
+        return {forward.z, 0.0, -forward.x};
+    }
+
+    col::CHAR_INF throughPortal(RenderContext *ctx, const PortalPass &pass, vec::vec3 hitPos, vec::vec3 dir,
+            double traveled, int depth);
+
+    //ポータルをくぐったあとのレイ1本分(originの高さが目の高さからずれていてもよい)
+    //traveledはここまでに進んだ距離で，霧と視界の残りはそこから数える
+    col::CHAR_INF traceScene(RenderContext *ctx, const PortalPass &pass, maze::Maze *map, vec::vec3 origin, vec::vec3 dir,
+            double traveled, int depth){
+        const double viewDistance = ctx->shading.getViewDistance();
+        const lighting::LightMap &light = (map == pass.home) ? ctx->light : ctx->portalLight;
+        double remaining = viewDistance - traveled;
+        int floorID;
+        double floorDist = rayCast::floorCellingDistance(dir.y, HEIGHT_FLOOR + origin.y, HEIGHT_CELLING - origin.y, &floorID);
+        rayCast::RaycastResult hit = rayCast::wallAs<rayCast::Scalar>(map, origin, dir, std::min(floorDist, remaining));
+        int lightLevel = lighting::LightMap::FULL;
+        if(hit.didHit){
+            lightLevel = light.faceAt(hit.cellX, hit.cellY, lighting::LightMap::faceIndex(hit.hitSurface, dir.x, dir.z));
+        }else if(floorDist <= remaining){
+            hit.distance = floorDist;
+            hit.objectID = floorID;
+            hit.hitSurface = 0;
+            lightLevel = light.floorAt((int)floor(origin.x + dir.x*floorDist), (int)floor(origin.z + dir.z*floorDist));
+        }else{
+            hit.distance = remaining;
+            hit.objectID = rayCast::OBJECT_FOG;
+            hit.hitSurface = 0;
+        }
+        col::CHAR_INF cell = ctx->shading.lookup(hit.objectID, hit.hitSurface, traveled + hit.distance, lightLevel);
+
+        //同じ迷路に戻ってきたら，ポータルがもう一度見えることがある
+        if(map == pass.home && depth <= ctx->portalMaxDepth){
+            vec::vec3 encountPos;
+            double portalDist = rayCast::spriteAs<rayCast::Scalar>(origin, dir, pass.pos, pass.normal, &encountPos);
+            if(0 <= portalDist && portalDist < hit.distance){
+                vec::vec2 portalUV;
+                rayCast::calcUVAs<rayCast::Scalar>(encountPos, pass.pos, pass.normal, &portalUV);
+                if(design::portal(portalUV) != 0){
+                    cell.back = {col::WHITE, false};
+                    cell.charactor = L' ';
+                }else if(design::portalWindow(portalUV)){
+                    cell = throughPortal(ctx, pass, encountPos, dir, traveled + portalDist, depth + 1);
+                }
+            }
+        }
+        return cell;
+    }
+
+    //出口から見た景色を低解像度で描いておく(出口か迷路が変わったときだけ)
+    void preparePortalSnapshot(RenderContext *ctx, const PortalPass &pass){
+        const PortalTarget &target = *pass.target;
+        const double viewDistance = ctx->shading.getViewDistance();
+        ctx->portalLight.update(target.map);
+        ScreenBuffer &snap = ctx->portalSnapshot;
+        if(ctx->snapshotMap == target.map && ctx->snapshotRevision == target.map->getRevision() &&
+                ctx->snapshotViewDistance == viewDistance &&
+                ctx->snapshotPos.x == target.pos.x && ctx->snapshotPos.y == target.pos.y && ctx->snapshotPos.z == target.pos.z &&
+                ctx->snapshotForward.x == target.forward.x && ctx->snapshotForward.z == target.forward.z &&
+                snap.width == PORTAL_SNAPSHOT_WIDTH){
+            return;
+        }
+        ctx->snapshotMap = target.map;
+        ctx->snapshotRevision = target.map->getRevision();
+        ctx->snapshotViewDistance = viewDistance;
+        ctx->snapshotPos = target.pos;
+        ctx->snapshotForward = target.forward;
+        snap.reallocate(PORTAL_SNAPSHOT_WIDTH, PORTAL_SNAPSHOT_HEIGHT);
+        const vec::vec3 right = portalRight(target.forward);
+        for(int y = 0; y < snap.height; y++){
+            for(int x = 0; x < snap.width; x++){
+                double u = screenU(x, &snap), v = screenV(y, &snap);
+                vec::vec3 dir = {right.x*u + target.forward.x*SCREEN_OFFSET, v, right.z*u + target.forward.z*SCREEN_OFFSET};
+                dir.normalize();
+                //スナップショットの中ではポータルをくぐらない
+                snap.set(y * snap.width + x, traceScene(ctx, pass, target.map, target.pos, dir, 0.0, ctx->portalMaxDepth + 1));
+            }
+        }
+    }
+
+    //リングの内側に当たったレイを出口側の迷路へ写して続ける
+    //くぐる回数か1フレームのレイの数が上限を超えたら，スナップショットの対応する画素を返す
+    col::CHAR_INF throughPortal(RenderContext *ctx, const PortalPass &pass, vec::vec3 hitPos, vec::vec3 dir,
+            double traveled, int depth){
+        const PortalTarget &target = *pass.target;
+        //入口の座標系(右，上，奥)．どちらの面から入ってもよい
+        double side = (dir.dot(pass.normal) < 0) ? -1.0 : 1.0;
+        vec::vec3 forwardIn = {pass.normal.x*side, 0.0, pass.normal.z*side};
+        forwardIn.normalize();
+        const vec::vec3 rightIn = portalRight(forwardIn);
+        const vec::vec3 rightOut = portalRight(target.forward);
+        double a = dir.dot(rightIn), b = dir.y, c = dir.dot(forwardIn);
+
+        if(depth > ctx->portalMaxDepth || ctx->portalRaysLeft <= 0){
+            ctx->portalFallbacks++;
+            const ScreenBuffer &snap = ctx->portalSnapshot;
+            if(c <= 0 || snap.width == 0) return ctx->shading.lookup(rayCast::OBJECT_FOG, 0, traveled);
+            //screenU / screenVの逆
+            double scale = std::min<int>(snap.height, snap.width);
+            int x = (int)((a / c * SCREEN_OFFSET * scale + snap.width) * 0.5);
+            int y = (int)((snap.height - b / c * SCREEN_OFFSET * scale) * 0.5);
+            x = std::max(0, std::min(snap.width - 1, x));
+            y = std::max(0, std::min(snap.height - 1, y));
+            return snap.get(y * snap.width + x);
+        }
+        ctx->portalRaysLeft--;
+        ctx->portalRaysUsed++;
+
+        vec::vec3 offset = hitPos - pass.pos;
+        double ou = offset.dot(rightIn);
+        vec::vec3 origin = {target.pos.x + rightOut.x*ou, target.pos.y + offset.y, target.pos.z + rightOut.z*ou};
+        vec::vec3 outDir = {rightOut.x*a + target.forward.x*c, b, rightOut.z*a + target.forward.z*c};
+        return traceScene(ctx, pass, target.map, origin, outDir, traveled, depth);
+    }
+
+    //portalVisibleがfalseならポータルとの交差判定を省く(PVSで見えないと分かっているとき)
+    //portalTargetがあればリングの内側にその先の迷路を描く
+    void setBuffer(RenderContext *ctx, Player *player, maze::Maze *map, ScreenBuffer *sb,
+            vec::vec3 portalPos, vec::vec3 portalNormal, bool portalVisible = true,
+            const PortalTarget *portalTarget = nullptr){
+        buildRowTable(ctx, player->getDir().y, sb);
+        vec::vec3 rayPosition = player->getPos();
+        bool useProfile = prepareProfile(ctx, map, rayPosition);
+        ctx->light.update(map);
+        const double viewDistance = ctx->shading.getViewDistance();
+        //この距離より近い床天井は壁に隠れない
+        double clearance = rayCast::clearance(map, rayPosition, 2);
+        double clearance2 = clearance*clearance;
+        const double cosPitch = cos(player->getDir().y), sinPitch = sin(player->getDir().y);
+        const double cosYaw = cos(player->getDir().x), sinYaw = sin(player->getDir().x);
+        const PortalPass pass = {map, portalPos, portalNormal, portalTarget};
+        const bool portalView = portalVisible && portalTarget != nullptr && portalTarget->map != nullptr;
+        ctx->portalRaysLeft = ctx->portalRayBudget;
+        ctx->portalRaysUsed = 0;
+        ctx->portalFallbacks = 0;
+        if(portalView) preparePortalSnapshot(ctx, pass);
+        explore::ExploredMap *explored = ctx->explored;
+        if(explored){
+            explored->beginFrame(map);
+            explored->mark(0, (int)rayPosition.x, (int)rayPosition.z);
+        }
+
+        for (int y = 0; y < sb->height; y++) {
+            const RowCast &row = ctx->rows[y];
+            int spanIndex = -1;
             for (int x = 0; x < sb->width; x++) {
                 //uv -1~1
-                double uvX = (x*2.-sb->width)/std::min<int>(sb->height, sb->width);
-                double uvY = (sb->height - y*2.0)/std::min<int>(sb->height, sb->width);
-                double offSet = 2.0;
+                double uvX = screenU(x, sb);
+                double uvY = screenV(y, sb);
                 
-                vec::vec3 rayDirection = {uvX, uvY, offSet};
-                vec::vec3 rayPosition = player->getPos();
-                rayDirection.normalize();
-                vec::rotate(rayDirection.y, rayDirection.z, player->getDir().y);//Pitch回転 (X軸を中心にYとZを回転)
-                vec::rotate(rayDirection.x, rayDirection.z, player->getDir().x);//Yaw回転 (Y軸を中心にXとZを回転)                
+                vec::vec3 rayDirection = {uvX, uvY, SCREEN_OFFSET};
+                double rayLength = rayDirection.length();
+                double invLength = 1.0 / rayLength;
+                rayDirection.x *= invLength;
+                rayDirection.y *= invLength;
+                rayDirection.z *= invLength;
+                vec::rotate(rayDirection.y, rayDirection.z, cosPitch, sinPitch);//Pitch回転 (X軸を中心にYとZを回転)
+                vec::rotate(rayDirection.x, rayDirection.z, cosYaw, sinYaw);//Yaw回転 (Y軸を中心にXとZを回転)                
                 
-                rayCast::RaycastResult mapResult = rayCast::map(map, rayPosition, rayDirection, 0.4, 0.8);
-                col::CHAR_INF pixelData = design::map(mapResult.objectID, mapResult.hitSurface);
+                rayCast::RaycastResult mapResult;
+                double floorDist = row.floorParam * rayLength;
+                double floorHorizontal2 = row.floorParam*row.floorParam * (uvX*uvX + row.rayZ*row.rayZ);
+                if(row.objectID != 0 && floorHorizontal2 < clearance2){
+                    //床天井が確実に手前にあるので壁のDDAを省略
+                    mapResult.didHit = false;
+                }else if(useProfile){
+                    //行の中では向きが単調に回るので，区間番号は前のピクセルから少し進めるだけ
+                    spanIndex = (spanIndex < 0) ? ctx->profile.find(rayDirection.x, rayDirection.z)
+                                         : ctx->profile.advance(spanIndex, rayDirection.x, rayDirection.z);
+                    double wallDist = ctx->profile.distance(spanIndex, rayDirection);
+                    mapResult.didHit = wallDist <= floorDist && wallDist <= viewDistance;
+                    if(mapResult.didHit){
+                        const rayCast::WallProfile::Span &span = ctx->profile.get(spanIndex);
+                        mapResult.distance = wallDist;
+                        mapResult.objectID = span.objectID;
+                        mapResult.hitSurface = span.side;
+                        ctx->profile.hitCell(spanIndex, rayDirection, wallDist, &mapResult.cellX, &mapResult.cellY);
+                    }
+                }else{
+                    //視界の外まではDDAを進めない
+                    mapResult = rayCast::wallAs<rayCast::Scalar>(map, rayPosition, rayDirection, std::min(floorDist, viewDistance));
+                }
+                int lightLevel = lighting::LightMap::FULL;
+                if(!mapResult.didHit){
+                    mapResult.hitSurface = 0;
+                    if(floorDist <= viewDistance){
+                        mapResult.distance = floorDist;
+                        mapResult.objectID = row.objectID;
+                        //床天井の当たったマス
+                        int floorX = (int)floor(rayPosition.x + rayDirection.x*floorDist);
+                        int floorY = (int)floor(rayPosition.z + rayDirection.z*floorDist);
+                        lightLevel = ctx->light.floorAt(floorX, floorY);
+                        if(explored) explored->mark(0, floorX, floorY);
+                    }else{
+                        mapResult.distance = viewDistance;
+                        mapResult.objectID = rayCast::OBJECT_FOG;
+                    }
+                }else{
+                    lightLevel = ctx->light.faceAt(mapResult.cellX, mapResult.cellY,
+                        lighting::LightMap::faceIndex(mapResult.hitSurface, rayDirection.x, rayDirection.z));
+                    if(explored) explored->mark(0, mapResult.cellX, mapResult.cellY);
+                }
+                col::CHAR_INF pixelData = ctx->shading.lookup(mapResult.objectID, mapResult.hitSurface, mapResult.distance, lightLevel);
 
                 vec::vec3 encountPos;
-                double portalDist = rayCast::sprite(rayPosition,rayDirection, portalPos, portalNormal, &encountPos);
+                double portalDist = portalVisible
+                    ? rayCast::spriteAs<rayCast::Scalar>(rayPosition,rayDirection, portalPos, portalNormal, &encountPos) : -1.0;
                 if(0 <= portalDist && portalDist < mapResult.distance){//壁よりポータルが近い
                     vec::vec2 portalUV;
-                    rayCast::calcUV(encountPos, portalPos, portalNormal, &portalUV);
+                    rayCast::calcUVAs<rayCast::Scalar>(encountPos, portalPos, portalNormal, &portalUV);
                     //if(portalUV.y < 0.0){
                     if(design::portal(portalUV) != 0){
                         pixelData.back = {col::WHITE, false};
                         pixelData.charactor = L' ';
+                    }else if(portalView && design::portalWindow(portalUV)){
+                        pixelData = throughPortal(ctx, pass, encountPos, rayDirection, portalDist, 1);
                     }
                 }
                 
@@ -46,34 +366,30 @@ namespace render
                 sb->buffer[id] = pixelData;
             }
         }
+        if(explored) explored->endFrame();
     }
 
-    void transAnimation(ScreenBuffer *dest, const ScreenBuffer *from, const ScreenBuffer *to, double progress){
-        bool fromIsUsable = (from!=NULL);
-        bool toIsUsable = (to!=NULL);
+    //from/toは静的な画面なので呼び出し側で一度だけ用意し，maskもdestの解像度で作っておく
+    void transAnimation(ScreenBuffer *dest, const ScreenBuffer *from, const ScreenBuffer *to,
+            const design::DissolveMask *mask, double progress){
+        const col::CHAR_INF exceptionCharInfo(L' ',{col::BLACK,false},{col::BLACK,false});
+        const design::DissolveCutoff cutoff = design::dissolveCutoff(progress);
 
         for(int y=0; y<dest->height; y++){
-            for(int x=0; x<dest->width; x++){
-                int destId = x+y*dest->width;
-                col::CHAR_INF fromCharInfo, toCharInfo;
-                col::CHAR_INF exceptionCharInfo(L' ',{col::BLACK,false},{col::BLACK,false});
-                
-                if(x < to->width && y < to->height && toIsUsable){
-                    int toId = x+y*to->width;
-                    toCharInfo = to->buffer[toId];
-                }else{
-                    toCharInfo = exceptionCharInfo;
-                }
+            //範囲外の判定は行ごとに済ませる
+            const col::CHAR_INF *fromRow = (from!=NULL && y < from->height) ? &from->buffer[y*from->width] : NULL;
+            const col::CHAR_INF *toRow = (to!=NULL && y < to->height) ? &to->buffer[y*to->width] : NULL;
+            int fromWidth = fromRow ? from->width : 0;
+            int toWidth = toRow ? to->width : 0;
 
-                if(x < from->width && y < from->height && fromIsUsable){
-                    int fromId = x+y*from->width;
-                    fromCharInfo = from->buffer[fromId];
-                }else{
-                    fromCharInfo = exceptionCharInfo;
-                }
-
-                design::dissolveAnimation((double)x/dest->width, (double)y/dest->height,
-                    progress, &dest->buffer[destId],&fromCharInfo, &toCharInfo);
+            const unsigned char *threshold = &mask->threshold[y*mask->width];
+            const unsigned char *noise = &mask->noise[y*mask->width];
+            col::CHAR_INF *destRow = &dest->buffer[y*dest->width];
+            for(int x=0; x<dest->width; x++){
+                const col::CHAR_INF *fromCharInfo = (x < fromWidth) ? &fromRow[x] : &exceptionCharInfo;
+                const col::CHAR_INF *toCharInfo = (x < toWidth) ? &toRow[x] : &exceptionCharInfo;
+                design::dissolveAnimation(threshold[x], noise[x], cutoff,
+                    &destRow[x], fromCharInfo, toCharInfo);
             }
         }
     }
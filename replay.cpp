@@ -0,0 +1,46 @@
+// 記録したセッション(MAZE_RECORD)を頭から最後まで待たずに再生する
+//   maze_replay <記録ファイル>            展開だけ(記録の中身と展開の速さを見る)
+//   maze_replay <記録ファイル> --present  端末へも書き出す(出力の符号化と端末の速さを測る)
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "console.hpp"
+#include "recorder.hpp"
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <recording> [--present]\n", argv[0]);
+        return 1;
+    }
+    bool present = argc > 2 && strcmp(argv[2], "--present") == 0;
+
+    record::Player player;
+    if (!player.open(argv[1])) {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    ScreenBuffer screen;
+    double sessionTime = 0;
+    long long frames = 0;
+    unsigned long long presentedBytes = 0;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    if (present) {
+        Console console; // デストラクタでは戻さないのでrestoreを呼ぶ
+        while (player.next(screen, sessionTime)) {
+            console.draw(screen);
+            presentedBytes += console.getLastFrameBytes();
+            frames++;
+        }
+        console.restore();
+    } else {
+        while (player.next(screen, sessionTime)) frames++;
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    printf("frames   : %lld (last %dx%d)\n", frames, screen.width, screen.height);
+    printf("session  : %.2f s\n", sessionTime);
+    printf("replay   : %.3f s (%.0f frames/s)\n", elapsed, elapsed > 0 ? frames / elapsed : 0.0);
+    if (present) printf("presented: %llu bytes (%.0f bytes/frame)\n", presentedBytes, frames ? (double)presentedBytes / frames : 0.0);
+    return 0;
+}
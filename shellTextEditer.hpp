@@ -12,51 +12,69 @@ public:
     std::string currentCommand;
     bool enterPressed=false;
     int cursorPos;
+    static const size_t MAX_COMMAND_LENGTH = 255; // これより長くは打てない(最初に確保したまま伸ばさない)
+
     shellTextEditer(ShellGame& sgame):sgame(&sgame){
+        currentCommand.reserve(MAX_COMMAND_LENGTH);
         reset();
     }
 
+    // 届いたキーを順に反映する．Enterが来たらそこで止め，残りは次のフレームに回す
     void update() {
-        input = inputManager.update();
-
-        // 文字入力
-        if (!input.typedChars.empty()) {
-            currentCommand.insert(cursorPos, input.typedChars);
-            cursorPos += input.typedChars.length();
-        }
-
-        // BackSpace
-        if (input.backspacePressed) {
-            if (cursorPos > 0) {
-                currentCommand.erase(cursorPos - 1, 1);
-                cursorPos--;
-            }
-        }
+        enterPressed = false;
+        InputEvent event;
+        while (inputManager.next(event)) {
+            switch (event.type) {
+            // 文字入力
+            case InputEvent::Type::Char:
+                if (currentCommand.length() < MAX_COMMAND_LENGTH) {
+                    currentCommand.insert(cursorPos, 1, event.ch);
+                    cursorPos++;
+                }
+                break;
 
-        // 矢印キー (パスワード入力中は無視)
-        if (sgame->currentState != ShellState::WAITING_PASSWORD) {
-            if (input.arrowLeftPressed) {
+            // BackSpace
+            case InputEvent::Type::Backspace:
                 if (cursorPos > 0) {
+                    currentCommand.erase(cursorPos - 1, 1);
                     cursorPos--;
                 }
-            }
-            if (input.arrowRightPressed) {
-                if (cursorPos < currentCommand.length()) {
+                break;
+
+            // 矢印キー (パスワード入力中は無視)
+            case InputEvent::Type::Left:
+                if (sgame->currentState != ShellState::WAITING_PASSWORD && cursorPos > 0) {
+                    cursorPos--;
+                }
+                break;
+            case InputEvent::Type::Right:
+                if (sgame->currentState != ShellState::WAITING_PASSWORD && cursorPos < currentCommand.length()) {
                     cursorPos++;
                 }
+                break;
+            // (Up/Downはコマンド履歴の実装で使用)
+
+            case InputEvent::Type::Enter:
+                enterPressed = true;
+                return;
+
+            default:
+                break;
             }
-            // (input.arrowUpPressed などはコマンド履歴の実装で使用)
         }
-        enterPressed = input.enterPressed;
+    }
+    // まだ読んでいないキーを捨てる(シェルを開いたときに，それまでのゲーム中のキーが入らないように)
+    void discardInput(){
+        InputEvent event;
+        while (inputManager.next(event)) {}
     }
     void reset(){
-        currentCommand = "";
+        currentCommand.clear(); // 確保した領域は残す
         cursorPos = 0;
         enterPressed = false;
     }
 private:
     ShellGame* sgame;
     TextInputManager inputManager;
-    TextInputResult input;
 };
 
@@ -1,2 +1,2 @@
 @echo off
-g++ main.cpp shellGame.cpp fileSystem.cpp commandProcessor.cpp ../input.cpp Process.cpp -o test_command.exe
\ No newline at end of file
+g++ main.cpp shellGame.cpp fileSystem.cpp commandProcessor.cpp ../input.cpp process.cpp -o test_command.exe
\ No newline at end of file
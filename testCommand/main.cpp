@@ -51,59 +51,64 @@ int main() {
     Render(game, currentCommand, cursorPos, historyLog);
 
     while (1) {
-        // 1. 入力
-        TextInputResult input = inputManager.update();
-
-        // 2. 状態更新
+        // 1. 入力と状態更新 (届いたキーを順に処理する)
         bool needsRender = false;
-
-        // 2a. 文字入力
-        if (!input.typedChars.empty()) {
-            // パスワード入力中も文字は受け付ける
-            currentCommand.insert(cursorPos, input.typedChars);
-            cursorPos += input.typedChars.length();
-            needsRender = true;
-        }
-
-        // 2b. BackSpace
-        if (input.backspacePressed) {
-            if (cursorPos > 0) {
-                currentCommand.erase(cursorPos - 1, 1);
-                cursorPos--;
+        bool exitRequested = false;
+        InputEvent event;
+        while (!exitRequested && inputManager.next(event)) {
+            switch (event.type) {
+            // 2a. 文字入力
+            case InputEvent::Type::Char:
+                // パスワード入力中も文字は受け付ける
+                currentCommand.insert(cursorPos, 1, event.ch);
+                cursorPos++;
                 needsRender = true;
-            }
-        }
+                break;
 
-        // 2c. 矢印キー (パスワード入力中は無視)
-        if (game.currentState != ShellState::WAITING_PASSWORD) {
-            if (input.arrowLeftPressed) {
+            // 2b. BackSpace
+            case InputEvent::Type::Backspace:
                 if (cursorPos > 0) {
+                    currentCommand.erase(cursorPos - 1, 1);
                     cursorPos--;
                     needsRender = true;
                 }
-            }
-            if (input.arrowRightPressed) {
-                if (cursorPos < currentCommand.length()) {
+                break;
+
+            // 2c. 矢印キー (パスワード入力中は無視)
+            case InputEvent::Type::Left:
+                if (game.currentState != ShellState::WAITING_PASSWORD && cursorPos > 0) {
+                    cursorPos--;
+                    needsRender = true;
+                }
+                break;
+            case InputEvent::Type::Right:
+                if (game.currentState != ShellState::WAITING_PASSWORD && cursorPos < currentCommand.length()) {
                     cursorPos++;
                     needsRender = true;
                 }
-            }
-            // (input.arrowUpPressed などはコマンド履歴の実装で使用)
-        }
+                break;
+            // (Up/Downはコマンド履歴の実装で使用)
+
+            // 2d. Enter
+            case InputEvent::Type::Enter:
+                if (game.currentState == ShellState::PROMPT && currentCommand == "exit") {
+                    system("cls"); // 終了前に画面をクリア
+                    std::cout << "Exiting Command Maze." << std::endl;
+                    exitRequested = true;
+                    break;
+                }
 
-        // 2d. Enter
-        if (input.enterPressed) {
-            if (game.currentState == ShellState::PROMPT && currentCommand == "exit") {
-                system("cls"); // 終了前に画面をクリア
-                std::cout << "Exiting Command Maze." << std::endl;
+                historyLog = game.update(currentCommand);
+                currentCommand.clear(); // コマンド実行後にバッファをクリア
+                cursorPos = 0;          // カーソル位置をリセット
+                needsRender = true;
                 break;
-            }
 
-            historyLog = game.update(currentCommand);
-            currentCommand = ""; // コマンド実行後にバッファをクリア
-            cursorPos = 0;       // カーソル位置をリセット
-            needsRender = true;
+            default:
+                break;
+            }
         }
+        if (exitRequested) break;
 
         // 3. 描画
         // 状態が変更された場合のみ再描画
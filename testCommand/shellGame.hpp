@@ -1,6 +1,6 @@
 #pragma once
 #include "fileSystem.hpp" 
-#include "Process.hpp"
+#include "process.hpp"
 #include "../input.hpp"
 #include <sstream>
 #include <string>
@@ -0,0 +1,138 @@
+// レイキャストのテスト(ctestから実行する．失敗があれば1を返す)
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "rayCast.hpp"
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, double x, double z){
+    if(ok) return;
+    printf("FAIL %s at (%.3f, %.3f)\n", what, x, z);
+    failures++;
+}
+
+//WallProfileで求めた壁までの距離が，全周でDDAの結果と一致するか
+static bool matchesDDA(maze::Maze *map, const rayCast::WallProfile &profile, vec::vec3 pos){
+    const int RAYS = 720;
+    for(int i=0; i<RAYS; i++){
+        double angle = (i + 0.5) * 6.283185307179586 / RAYS;
+        vec::vec3 dir = {cos(angle), 0.0, sin(angle)};
+        rayCast::RaycastResult hit = rayCast::wall(map, pos, dir, 1e30);
+        double d = profile.distance(profile.find(dir.x, dir.z), dir);
+        if(fabs(d - hit.distance) > 1e-6) return false;
+    }
+    return true;
+}
+
+//格子点(壁の角)と格子線の上に立ったときにWallProfile::buildが必ず終わること
+//(面の端が真横になって区間が進まず，止まらなくなったことがある)
+static void testWallProfileOnLattice(){
+    maze::Maze map;
+    map.generate(8, 8);//最初の呼び出しで種が設定されるので，そのあとで種を決め直す
+    for(int seed=1; seed<=20; seed++){
+        srand(seed);
+        map.generate(8, 8);
+        for(int z2=0; z2<=map.getHeight()*2; z2++){
+            for(int x2=0; x2<=map.getWidth()*2; x2++){
+                if(x2 % 2 != 0 && z2 % 2 != 0) continue;//マスの中は格子の上ではない
+                vec::vec3 pos = {x2 * 0.5, 0.5, z2 * 0.5};
+                rayCast::WallProfile profile;
+                if(profile.build(&map, pos)){
+                    check(matchesDDA(&map, profile, pos), "profile distance", pos.x, pos.z);
+                }
+            }
+        }
+    }
+}
+
+//画面1枚分の1ピクセル．壁なら当たった面とマス，床天井ならobjectIDだけで比べる
+struct Pixel{
+    int objectID;
+    int side;
+    int cellX, cellY;
+    double distance;
+};
+
+//render::setBufferと同じ向きのレイを水平に振り，壁か床天井のどちらが見えるかをTで求める
+template<typename T>
+static void renderAs(maze::Maze *map, vec::vec3 pos, double yaw, int width, int height, std::vector<Pixel> *image){
+    const double HEIGHT_FLOOR = 0.4, HEIGHT_CELLING = 0.8, SCREEN_OFFSET = 2.0, VIEW_DISTANCE = 12.0;
+    image->resize(width * height);
+    for(int y=0; y<height; y++){
+        for(int x=0; x<width; x++){
+            double u = (x*2.0 - width) / height, v = (height - y*2.0) / height;
+            vec::vec3 dir = {u, v, SCREEN_OFFSET};
+            dir.normalize();
+            vec::rotate(dir.x, dir.z, cos(yaw), sin(yaw));
+            int floorID;
+            double floorDist = rayCast::floorCellingDistance(dir.y, HEIGHT_FLOOR, HEIGHT_CELLING, &floorID);
+            rayCast::RaycastResult hit = rayCast::wallAs<T>(map, pos, dir, std::min(floorDist, VIEW_DISTANCE));
+            Pixel &p = (*image)[y*width + x];
+            if(hit.didHit){
+                p = {hit.objectID, hit.hitSurface, hit.cellX, hit.cellY, hit.distance};
+            }else if(floorDist <= VIEW_DISTANCE){
+                p = {floorID, 0, -1, -1, floorDist};
+            }else{
+                p = {rayCast::OBJECT_FOG, 0, -1, -1, VIEW_DISTANCE};
+            }
+        }
+    }
+}
+
+//doubleとの差が許せる範囲か．見えるもの(面とマス)が違うピクセルはmaxMismatch以下，
+//同じものが見えているピクセルの距離の差はmaxError以下
+template<typename T>
+static void testScalarAgainstDouble(const char *name, double maxMismatch, double maxError){
+    const int WIDTH = 80, HEIGHT = 24;
+    maze::Maze map;
+    map.generate(8, 8);
+    std::vector<Pixel> reference, image;
+    int pixels = 0, mismatches = 0;
+    double worstError = 0.0;
+    for(int seed=1; seed<=3; seed++){
+        srand(seed);
+        map.generate(8, 8);
+        for(int cy=0; cy<map.getHeight(); cy++){
+            for(int cx=0; cx<map.getWidth(); cx++){
+                if(map.getNum(cx, cy) > 0) continue;
+                vec::vec3 pos = {cx + 0.37, 0.5, cy + 0.61};
+                for(int i=0; i<4; i++){
+                    double yaw = 0.3 + i * 1.5707963267948966;
+                    renderAs<double>(&map, pos, yaw, WIDTH, HEIGHT, &reference);
+                    renderAs<T>(&map, pos, yaw, WIDTH, HEIGHT, &image);
+                    for(size_t k=0; k<reference.size(); k++){
+                        const Pixel &a = reference[k], &b = image[k];
+                        pixels++;
+                        if(a.objectID != b.objectID || a.side != b.side || a.cellX != b.cellX || a.cellY != b.cellY){
+                            mismatches++;
+                            continue;
+                        }
+                        worstError = std::max(worstError, fabs(a.distance - b.distance));
+                    }
+                }
+            }
+        }
+    }
+    double mismatchRate = (double)mismatches / pixels;
+    printf("%s: mismatch %.4f%% (%d / %d), max distance error %.2e\n",
+        name, mismatchRate * 100.0, mismatches, pixels, worstError);
+    if(mismatchRate > maxMismatch){
+        printf("FAIL %s mismatch rate %.4f > %.4f\n", name, mismatchRate, maxMismatch);
+        failures++;
+    }
+    if(worstError > maxError){
+        printf("FAIL %s distance error %.2e > %.2e\n", name, worstError, maxError);
+        failures++;
+    }
+}
+
+int main(){
+    testWallProfileOnLattice();
+    testScalarAgainstDouble<float>("float", 0.001, 5e-5);
+    testScalarAgainstDouble<num::Fixed16>("Fixed16", 0.001, 5e-3);
+    if(failures == 0) printf("all tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+// 画面の記録と再生のテスト(ctestから実行する．失敗があれば1を返す)
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "recorder.hpp"
+
+static int failures = 0;
+static const char *PATH = "test_recorder.tmp";
+
+static void check(bool ok, const char *what, int frame){
+    if(ok) return;
+    printf("FAIL %s (frame %d)\n", what, frame);
+    failures++;
+}
+
+static bool sameScreen(const ScreenBuffer &a, const ScreenBuffer &b){
+    if(a.width != b.width || a.height != b.height) return false;
+    for(size_t i=0; i<a.buffer.size(); i++){
+        if(a.buffer[i] != b.buffer[i]) return false;
+    }
+    return true;
+}
+
+//ゲームの画面に似せて，少しずつ書き換わり，ときどき大きさの変わるフレームを作って記録し，
+//再生したフレームが1枚ずつ元と一致するか
+static void testRoundTrip(){
+    const int FRAMES = 3000;
+    srand(1);
+    std::vector<ScreenBuffer> frames;
+    ScreenBuffer screen;
+    screen.reallocate(80, 24);
+    record::Recorder recorder;
+    check(recorder.open(PATH), "open for writing", -1);
+    for(int f=0; f<FRAMES; f++){
+        if(f % 700 == 699) screen.reallocate(60 + rand() % 60, 20 + rand() % 20);
+        int changes = rand() % 200;
+        for(int k=0; k<changes; k++){
+            int id = rand() % (screen.width * screen.height);
+            unsigned char fore = (unsigned char)(rand() % 256), back = (unsigned char)(rand() % 256);
+            screen.buffer[id] = col::CHAR_INF((wchar_t)(0x20 + rand() % 0x2800), col::COL_INF::indexed(fore), col::COL_INF::indexed(back));
+        }
+        recorder.addFrame(screen);
+        frames.push_back(screen);
+    }
+    recorder.close();
+
+    record::Player player;
+    check(player.open(PATH), "open for reading", -1);
+    ScreenBuffer replayed;
+    double time = 0.0, lastTime = 0.0;
+    int f = 0;
+    for(; f<FRAMES && player.next(replayed, time); f++){
+        check(sameScreen(replayed, frames[f]), "frame differs", f);
+        check(time >= lastTime, "time goes back", f);
+        lastTime = time;
+        if(failures > 10) return;
+    }
+    check(f == FRAMES, "frames missing", f);
+    check(!player.next(replayed, time), "frames after the end", f);
+}
+
+//フレームの中身をそのまま並べて1ブロックのファイルにする(壊れた入力を作るため)
+static void writeBlockFile(const std::vector<uint8_t> &raw, uint32_t rawSize, bool truncate){
+    std::vector<uint8_t> packed;
+    record::lz::compress(raw.data(), raw.size(), packed);
+    FILE *file = fopen(PATH, "wb");
+    fwrite(record::MAGIC, 1, 4, file);
+    const uint32_t header[3] = {record::VERSION, rawSize, (uint32_t)packed.size()};
+    for(int i=0; i<3; i++){
+        uint8_t bytes[4] = {(uint8_t)header[i], (uint8_t)(header[i] >> 8), (uint8_t)(header[i] >> 16), (uint8_t)(header[i] >> 24)};
+        fwrite(bytes, 1, 4, file);
+    }
+    fwrite(packed.data(), 1, truncate ? packed.size() / 2 : packed.size(), file);
+    fclose(file);
+}
+
+//フレーム1枚 (dt 幅 高さ 連なりの数 と，連なり1つ分の 行の差 列の差 セルの数 (属性値 文字)...)
+static std::vector<uint8_t> frame(uint32_t width, uint32_t height, uint32_t dy, uint32_t dx, uint32_t length, uint32_t cells){
+    std::vector<uint8_t> raw;
+    record::putVarint(raw, 1000);
+    record::putVarint(raw, width);
+    record::putVarint(raw, height);
+    record::putVarint(raw, 1);
+    record::putVarint(raw, dy);
+    record::putVarint(raw, dx);
+    record::putVarint(raw, length);
+    for(uint32_t k=0; k<cells; k++){
+        record::putVarint(raw, 0x0007);
+        record::putVarint(raw, 'x');
+    }
+    return raw;
+}
+
+//壊れたファイルはnextがfalseを返すだけで，範囲外に書いたり巨大な確保をしたりしない
+static void testCorrupt(){
+    struct Case{
+        const char *name;
+        std::vector<uint8_t> raw;
+        bool truncate;
+        bool valid;
+    };
+    const Case cases[] = {
+        {"valid run", frame(4, 2, 1, 1, 3, 3), false, true},
+        {"dx wraps around", frame(4, 2, 0, 0xFFFFFFFE, 4, 4), false, false},
+        {"length wraps around", frame(4, 2, 0, 2, 0xFFFFFFFF, 4), false, false},
+        {"dy wraps around", frame(4, 2, 0xFFFFFFFF, 0, 1, 1), false, false},
+        {"run past the right edge", frame(4, 2, 0, 2, 3, 3), false, false},
+        {"run below the last row", frame(4, 2, 2, 0, 1, 1), false, false},
+        {"huge width", frame(0xFFFFFFFF, 2, 0, 0, 1, 1), false, false},
+        {"huge screen", frame(4096, 4096, 0, 0, 1, 1), false, false},
+        {"cells missing", frame(4, 2, 0, 0, 4, 2), false, false},
+        {"truncated block", frame(4, 2, 0, 0, 4, 4), true, false},
+    };
+    for(const Case &c : cases){
+        writeBlockFile(c.raw, (uint32_t)c.raw.size(), c.truncate);
+        record::Player player;
+        ScreenBuffer screen;
+        double time;
+        bool ok = player.open(PATH) && player.next(screen, time);
+        if(ok != c.valid){
+            printf("FAIL %s: next returned %s\n", c.name, ok ? "true" : "false");
+            failures++;
+        }
+    }
+    //ブロックの大きさが巨大
+    std::vector<uint8_t> raw = frame(4, 2, 0, 0, 1, 1);
+    writeBlockFile(raw, 0xFFFFFFF0, false);
+    record::Player player;
+    ScreenBuffer screen;
+    double time;
+    check(!(player.open(PATH) && player.next(screen, time)), "huge block accepted", -1);
+}
+
+int main(){
+    testRoundTrip();
+    testCorrupt();
+    remove(PATH);
+    if(failures == 0) printf("all tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
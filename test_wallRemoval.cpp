@@ -0,0 +1,89 @@
+// 壁を壊したあとのキャッシュのテスト(ctestから実行する．失敗があれば1を返す)
+// 少しずつ直した結果が，壊したあとの迷路から作り直した結果と一致するか
+#include <stdio.h>
+#include <stdlib.h>
+#include "maze.hpp"
+#include "visibility.hpp"
+#include "lightMap.hpp"
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, int seed, int x, int y){
+    if(ok) return;
+    printf("FAIL %s (seed %d) at (%d, %d)\n", what, seed, x, y);
+    failures++;
+}
+
+//内側の壁をcount個，場所を乱数で選んで壊す
+static void removeRandomWalls(maze::Maze *map, int count){
+    while(count > 0){
+        int x = 1 + rand() % (map->getWidth() - 2);
+        int y = 1 + rand() % (map->getHeight() - 2);
+        if(map->removeWall(x, y)) count--;
+    }
+}
+
+static void testPVSUpdate(){
+    maze::Maze map;
+    map.generate(6, 6);//最初の呼び出しで種が設定されるので，そのあとで種を決め直す
+    for(int seed=1; seed<=10; seed++){
+        srand(seed);
+        map.generate(6, 6);
+        visibility::PVS pvs;
+        pvs.build(&map, 1);
+        //1つずつ追いつかせる場合と，まとめて壊してから追いつかせる場合
+        removeRandomWalls(&map, 1);
+        pvs.update(&map, 1);
+        removeRandomWalls(&map, 3);
+        pvs.update(&map, 1);
+        check(pvs.isBuiltFor(&map), "pvs revision", seed, -1, -1);
+
+        visibility::PVS rebuilt;
+        rebuilt.build(&map, 1);
+        const int width = map.getWidth(), height = map.getHeight();
+        for(int from=0; from<width*height; from++){
+            for(int to=0; to<width*height; to++){
+                int fx = from % width, fy = from / width, tx = to % width, ty = to / width;
+                if(pvs.isVisible(fx, fy, tx, ty) != rebuilt.isVisible(fx, fy, tx, ty)){
+                    check(false, "pvs visibility", seed, fx, fy);
+                    from = width*height;//迷路1つにつき1回だけ知らせる
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static void testLightMapUpdate(){
+    maze::Maze map;
+    map.generate(6, 6);
+    for(int seed=1; seed<=10; seed++){
+        srand(seed);
+        map.generate(6, 6);
+        lighting::LightMap light;
+        light.bake(&map, 1);
+        removeRandomWalls(&map, 1);
+        light.update(&map, 1);
+        removeRandomWalls(&map, 3);
+        light.update(&map, 1);
+        check(light.isBuiltFor(&map), "light revision", seed, -1, -1);
+
+        lighting::LightMap rebaked;
+        rebaked.bake(&map, 1);
+        bool same = true;
+        for(int y=0; y<map.getHeight() && same; y++){
+            for(int x=0; x<map.getWidth() && same; x++){
+                same = light.floorAt(x, y) == rebaked.floorAt(x, y);
+                for(int f=0; f<4 && same; f++) same = light.faceAt(x, y, f) == rebaked.faceAt(x, y, f);
+                check(same, "light level", seed, x, y);
+            }
+        }
+    }
+}
+
+int main(){
+    testPVSUpdate();
+    testLightMapUpdate();
+    if(failures == 0) printf("all tests passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -1,32 +1,37 @@
 #pragma once
 #include <cmath>
+#include "numeric.hpp"
 
 
 namespace vec
 {
-    struct vec2 {
-        double x = 0.0, y = 0.0;
+    // 数値型Tはdouble・float・num::Fixed16のどれか(レイキャストの数値型を切り替えるため)
+    template<typename T>
+    struct basic_vec2 {
+        typedef basic_vec2 vec2;
+        T x = T(), y = T();
 
         // コンストラクタを追加
-        vec2() = default;
-        vec2(double x, double y) : x(x), y(y) {}
+        basic_vec2() = default;
+        basic_vec2(T x, T y) : x(x), y(y) {}
 
         // メンバ関数化
-        double length() const { // constを付けるとメンバ変数を変更しない関数だと示せる
-            return std::sqrt(x*x + y*y);
+        T length() const { // constを付けるとメンバ変数を変更しない関数だと示せる
+            using std::sqrt;
+            return sqrt(x*x + y*y);
         }
 
-        double dotSelf() const {
+        T dotSelf() const {
             return x*x + y*y;
         }
 
-        double dot(vec2 n) const {
+        T dot(vec2 n) const {
             return x*n.x + y*n.y;
         }
         
         void normalize() {
-            double len = length();
-            if (len > 1e-9) { // ゼロ除算を避ける
+            T len = length();
+            if (len > num::Traits<T>::epsilon()) { // ゼロ除算を避ける
                 x /= len;
                 y /= len;
             }
@@ -47,29 +52,40 @@ namespace vec
         }
     };
 
+    typedef basic_vec2<double> vec2;
+
     void rotate(double& a, double& b, double angle){
         double oldA = a;
         a = a * cos(angle) - b * sin(angle);
         b = oldA   * sin(angle) + b * cos(angle);
     }
+    //cos・sinを計算済みの場合
+    inline void rotate(double& a, double& b, double c, double s){
+        double oldA = a;
+        a = a * c - b * s;
+        b = oldA * s + b * c;
+    }
 
-    struct vec3 {
-        double x = 0.0, y = 0.0, z = 0.0;
+    template<typename T>
+    struct basic_vec3 {
+        typedef basic_vec3 vec3;
+        T x = T(), y = T(), z = T();
 
         // コンストラクタを追加
-        vec3() = default;
-        vec3(double x, double y, double z) : x(x), y(y), z(z) {}
+        basic_vec3() = default;
+        basic_vec3(T x, T y, T z) : x(x), y(y), z(z) {}
 
         // メンバ関数化
-        double length() const { // constを付けるとメンバ変数を変更しない関数だと示せる
-            return std::sqrt(x*x + y*y + z*z);
+        T length() const { // constを付けるとメンバ変数を変更しない関数だと示せる
+            using std::sqrt;
+            return sqrt(x*x + y*y + z*z);
         }
 
-        double dotSelf() const {
+        T dotSelf() const {
             return x*x + y*y + z*z;
         }
 
-        double dot(vec3 n) const {
+        T dot(vec3 n) const {
             return x*n.x + y*n.y + z*n.z;
         }
 
@@ -80,8 +96,8 @@ namespace vec
         }
         
         void normalize() {
-            double len = length();
-            if (len > 1e-9) { // ゼロ除算を避ける
+            T len = length();
+            if (len > num::Traits<T>::epsilon()) { // ゼロ除算を避ける
                 x /= len;
                 y /= len;
                 z /= len;
@@ -102,5 +118,19 @@ namespace vec
             return vec3(x / other.x, y / other.y, z / other.z);
         }
     };
+    typedef basic_vec3<double> vec3;
+
+    // 数値型の変換
+    template<typename To, typename From>
+    basic_vec3<To> convert(const basic_vec3<From>& v){
+        return basic_vec3<To>(num::fromDouble<To>(num::toDouble(v.x)),
+                              num::fromDouble<To>(num::toDouble(v.y)),
+                              num::fromDouble<To>(num::toDouble(v.z)));
+    }
+    template<typename To, typename From>
+    basic_vec2<To> convert(const basic_vec2<From>& v){
+        return basic_vec2<To>(num::fromDouble<To>(num::toDouble(v.x)),
+                              num::fromDouble<To>(num::toDouble(v.y)));
+    }
 
 }
\ No newline at end of file
@@ -0,0 +1,235 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include "vec.hpp"
+#include "maze.hpp"
+#include "rayCast.hpp"
+
+//マスごとの見える可能性のあるマスの集合(PVS)
+namespace visibility
+{
+    //あるマスの中のどこかから，別のマスの中のどこかが見えるかを前もって調べておく
+    //スプライトやNPCはビットを1つ見るだけで見えないものを捨てられる
+    class PVS{
+    public:
+        //マスの中で視線を出す点(辺ぎりぎりと中央)．この組み合わせの線分のどれかが通れば見える扱い
+        static const int SAMPLES_PER_AXIS = 3;
+        static const int SAMPLES = SAMPLES_PER_AXIS * SAMPLES_PER_AXIS;
+
+        //迷路全体を作り直す．threadCountが0ならCPUの数だけワーカーを使う
+        void build(const maze::Maze *map, int threadCount = 0){
+            width = map->getWidth();
+            height = map->getHeight();
+            cells.assign(width * height, {});
+            std::vector<int> targets;
+            for(int i=0; i<width*height; i++){
+                if(map->getMapData()[i] == 0) targets.push_back(i);
+            }
+            computeCells(map, targets, threadCount);
+            revision = map->getRevision();
+            generation = map->getGeneration();
+            appliedRemovals = map->getRemovedWalls().size();
+            built = true;
+        }
+
+        //迷路に追いつかせる．階が変わっていれば作り直し，壁が壊されただけなら
+        //前回から壊された壁の周りだけを調べ直す(毎フレーム呼んでよい)
+        void update(const maze::Maze *map, int threadCount = 0){
+            if(isBuiltFor(map)) return;
+            const std::vector<maze::RemovedWall> &removed = map->getRemovedWalls();
+            if(!built || generation != map->getGeneration() || appliedRemovals > removed.size() ||
+                    map->getWidth() != width || map->getHeight() != height){
+                build(map, threadCount);
+                return;
+            }
+            for(; appliedRemovals < removed.size(); appliedRemovals++){
+                onWallRemoved(map, removed[appliedRemovals].x, removed[appliedRemovals].y, threadCount);
+            }
+            revision = map->getRevision();
+        }
+
+        bool isBuiltFor(const maze::Maze *map) const {
+            return built && revision == map->getRevision() && width == map->getWidth() && height == map->getHeight();
+        }
+
+        //マス(fromX,fromY)から(toX,toY)が見える可能性があるか．範囲外や壁のマスからは何も見えない
+        bool isVisible(int fromX, int fromY, int toX, int toY) const {
+            if(fromX < 0 || fromX >= width || fromY < 0 || fromY >= height) return false;
+            if(toX < 0 || toX >= width || toY < 0 || toY >= height) return false;
+            const std::vector<Word> &words = cells[fromY * width + fromX];
+            int cell = toY * width + toX;
+            uint32_t index = (uint32_t)(cell / 64);
+            //単語番号の昇順に並んでいるので二分探索
+            std::vector<Word>::const_iterator it = std::lower_bound(words.begin(), words.end(), index,
+                [](const Word &w, uint32_t i){ return w.index < i; });
+            if(it == words.end() || it->index != index) return false;
+            return ((it->bits >> (cell % 64)) & 1) != 0;
+        }
+        bool isVisible(vec::vec3 from, vec::vec3 to) const {
+            return isVisible((int)from.x, (int)from.z, (int)to.x, (int)to.z);
+        }
+
+        //圧縮後の大きさ(単語の数)
+        size_t wordCount() const {
+            size_t total = 0;
+            for(size_t i=0; i<cells.size(); i++) total += cells[i].size();
+            return total;
+        }
+
+    private:
+        //0でない64ビットの単語だけを持つ疎なビット列
+        struct Word{
+            uint32_t index;
+            uint64_t bits;
+        };
+
+        //ワーカーごとの作業領域
+        struct Scratch{
+            std::vector<uint32_t> stamp;
+            uint32_t counter = 0;
+            std::vector<int> frontier, next, visible;
+            std::vector<rayCast::SightQuery> queries;
+            std::vector<uint64_t> result;
+        };
+
+        //壁(x,y)が壊されたあと．新しく見えるようになる組は必ず(x,y)を通るので
+        //(x,y)から見えるマスだけを調べ直せばよい
+        void onWallRemoved(const maze::Maze *map, int x, int y, int threadCount){
+            int removed = y * width + x;
+            std::vector<int> targets(1, removed);
+            computeCells(map, targets, 1);
+            targets.clear();
+            forEachVisible(removed, [&](int cell){
+                if(cell != removed) targets.push_back(cell);
+            });
+            computeCells(map, targets, threadCount);
+        }
+
+        template<typename F>
+        void forEachVisible(int cell, F func) const {
+            const std::vector<Word> &words = cells[cell];
+            for(size_t i=0; i<words.size(); i++){
+                uint64_t bits = words[i].bits;
+                while(bits){
+                    int bit = 0;
+                    while(((bits >> bit) & 1) == 0) bit++;
+                    func((int)words[i].index * 64 + bit);
+                    bits &= bits - 1;
+                }
+            }
+        }
+
+        //targetsのマスを作り直す．1マスずつワーカーが取っていく
+        void computeCells(const maze::Maze *map, const std::vector<int> &targets, int threadCount){
+            if(threadCount <= 0) threadCount = (int)std::thread::hardware_concurrency();
+            threadCount = std::max(1, std::min(threadCount, (int)targets.size()));
+            std::atomic<int> nextTarget(0);
+            auto worker = [&](){
+                Scratch scratch;
+                for(int i = nextTarget++; i < (int)targets.size(); i = nextTarget++){
+                    computeCell(map, targets[i], &scratch);
+                }
+            };
+            if(threadCount == 1){
+                worker();
+                return;
+            }
+            std::vector<std::thread> workers;
+            for(int t=0; t<threadCount-1; t++) workers.emplace_back(worker);
+            worker();
+            for(size_t t=0; t<workers.size(); t++) workers[t].join();
+        }
+
+        //見えるマスに隣接するマスだけを候補にして広げていく
+        //(線分が通るマスはすべて見えるマスなので，見える範囲は隣接でつながっている)
+        void computeCell(const maze::Maze *map, int origin, Scratch *s){
+            const int *data = map->getMapData();
+            std::vector<Word> &words = cells[origin];
+            words.clear();
+            if(data[origin] != 0) return;
+
+            if(s->stamp.size() != cells.size()){
+                s->stamp.assign(cells.size(), 0);
+                s->counter = 0;
+            }
+            if(++s->counter == 0){
+                std::fill(s->stamp.begin(), s->stamp.end(), 0);
+                s->counter = 1;
+            }
+            const uint32_t mark = s->counter;
+            const int ox = origin % width, oy = origin / width;
+
+            s->visible.clear();
+            s->visible.push_back(origin);
+            s->stamp[origin] = mark;
+            s->frontier.clear();
+            pushNeighbors(data, origin, mark, s, &s->frontier);
+
+            while(!s->frontier.empty()){
+                s->queries.clear();
+                for(size_t f=0; f<s->frontier.size(); f++){
+                    int cx = s->frontier[f] % width, cy = s->frontier[f] / width;
+                    for(int a=0; a<SAMPLES; a++){
+                        for(int b=0; b<SAMPLES; b++){
+                            rayCast::SightQuery q;
+                            q.from = {ox + sampleOffset(a % SAMPLES_PER_AXIS), 0.0, oy + sampleOffset(a / SAMPLES_PER_AXIS)};
+                            q.to = {cx + sampleOffset(b % SAMPLES_PER_AXIS), 0.0, cy + sampleOffset(b / SAMPLES_PER_AXIS)};
+                            s->queries.push_back(q);
+                        }
+                    }
+                }
+                rayCast::lineOfSight(map, s->queries.data(), (int)s->queries.size(), &s->result);
+
+                s->next.clear();
+                for(size_t f=0; f<s->frontier.size(); f++){
+                    bool seen = false;
+                    for(int k=0; k<SAMPLES*SAMPLES && !seen; k++){
+                        seen = rayCast::isVisible(s->result, (int)f * SAMPLES * SAMPLES + k);
+                    }
+                    if(!seen) continue;
+                    s->visible.push_back(s->frontier[f]);
+                    pushNeighbors(data, s->frontier[f], mark, s, &s->next);
+                }
+                s->frontier.swap(s->next);
+            }
+
+            //単語番号順に詰める
+            std::sort(s->visible.begin(), s->visible.end());
+            for(size_t i=0; i<s->visible.size(); i++){
+                uint32_t index = (uint32_t)(s->visible[i] / 64);
+                if(words.empty() || words.back().index != index) words.push_back({index, 0});
+                words.back().bits |= (uint64_t)1 << (s->visible[i] % 64);
+            }
+            words.shrink_to_fit();
+        }
+
+        void pushNeighbors(const int *data, int cell, uint32_t mark, Scratch *s, std::vector<int> *out){
+            const int x = cell % width, y = cell / width;
+            const int neighbors[4][2] = {{1,0},{-1,0},{0,1},{0,-1}};
+            for(int i=0; i<4; i++){
+                int nx = x + neighbors[i][0], ny = y + neighbors[i][1];
+                if(nx < 0 || nx >= width || ny < 0 || ny >= height) continue;
+                int n = ny * width + nx;
+                if(s->stamp[n] == mark || data[n] != 0) continue;
+                s->stamp[n] = mark;
+                out->push_back(n);
+            }
+        }
+
+        static double sampleOffset(int i){
+            const double offsets[SAMPLES_PER_AXIS] = {0.02, 0.5, 0.98};
+            return offsets[i];
+        }
+
+        std::vector<std::vector<Word>> cells;
+        int width = 0;
+        int height = 0;
+        unsigned int revision = 0;
+        unsigned int generation = 0;
+        size_t appliedRemovals = 0;//getRemovedWallsのうち反映済みの数
+        bool built = false;
+    };
+}